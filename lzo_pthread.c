@@ -6,8 +6,10 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdbool.h>
-#include <sys/sysinfo.h>
+#include <sys/stat.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "math.h"
 
 //reqired configuration
@@ -15,432 +17,633 @@ static const char *progname = NULL;
 #define WANT_LZO_MALLOC 1
 #define WANT_XMALLOC 1
 #include "portab.h"
-lzo_voidp wrkmem;
+#include "plzo.h"
+#include "plzo_bench.h"
 
-//1 byte var to hold thread count
-char static thread_count = 0;
-//struct to hold the data to be processed
-struct arg_s {
+//worker count, plzo_cpu_threads() unless -t is given
+static int thread_count = 0;
+//worker pool shared by every parallel run
+static plzo_pool *pool = NULL;
+//target chunk size when compressing files given on the command line
+static lzo_uint block_size = PLZO_STREAM_BLOCK_SIZE;
+//workers bound per NUMA node and file buffers first touched by the node that compresses them
+static bool numa = false;
+//cpus of the workers and of the thread that reads and writes, NULL for the whole affinity mask
+static const char *cpus = NULL;
+static const char *io_cpus = NULL;
+//one file of a command line run, compressed as a single pool job
+struct file_job_s {
+    char *name;
+    lzo_uint in_len;
     lzo_bytep data;
-    lzo_bytep out ;
-    lzo_uint data_size;
-    lzo_uint out_size;
+    lzo_bytep out;
+    struct plzo_block_s *blocks;
+    int count;
+    plzo_job *job;
+    unsigned long long held; // taken from the memory budget
 };
-//struct to hold the results
-struct result_s {
-    lzo_uint in_size;
-    lzo_uint out_size;
-    double ratio;
-    double time;
+//growable list of files to compress
+struct file_list_s {
+    struct file_job_s *files;
+    int count;
+    int size;
 };
-void *compress(void *arg) {
-    struct arg_s *args = (struct arg_s *) arg;
-    wrkmem = (lzo_voidp) xmalloc(LZO1X_1_MEM_COMPRESS);
-    int r = lzo1x_1_compress(args->data, args->data_size, args->out, &args->out_size, wrkmem);
-    if (r != LZO_E_OK){
-        printf("parallel comp error %d\n", r);
+void add_file(struct file_list_s *list, char *name, lzo_uint in_len){
+    if (list->count == list->size){
+        list->size = list->size ? list->size * 2 : 64;
+        struct file_job_s *files = (struct file_job_s *) xmalloc(sizeof(struct file_job_s) * list->size);
+        if (list->count > 0){
+            memcpy(files, list->files, sizeof(struct file_job_s) * list->count);
+        }
+        free(list->files);
+        list->files = files;
     }
+    list->files[list->count].name = name;
+    list->files[list->count].in_len = in_len;
+    list->count++;
 }
-void *decompress(void *arg) {
-    struct arg_s *args = (struct arg_s *) arg;
-    int r = lzo1x_decompress(args->data, args->data_size, args->out, &args->out_size, NULL);
-    if (r != LZO_E_OK){
-        printf("parallel decomp error %d\n", r);
+//collects every regular file below dirname, symbolic links are not followed and .plzo files are skipped,
+//LZO_E_ERROR if a directory of the tree cannot be read
+int walk_tree(const char *dirname, struct file_list_s *list){
+    DIR *dir = opendir(dirname);
+    struct dirent *entry;
+    struct stat st;
+    int status = LZO_E_OK;
+    if (dir == NULL){
+        printf("cannot open directory %s\n", dirname);
+        return LZO_E_ERROR;
     }
+    while ((entry = readdir(dir)) != NULL){
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0){
+            continue;
+        }
+        size_t len = strlen(dirname);
+        char *path = (char *) xmalloc(len + strlen(entry->d_name) + 2);
+        strcpy(path, dirname);
+        if (len == 0 || dirname[len - 1] != '/'){
+            strcat(path, "/");
+        }
+        strcat(path, entry->d_name);
+        if (lstat(path, &st) != 0){
+            free(path);
+        } else if (S_ISDIR(st.st_mode)){
+            if (walk_tree(path, list) != LZO_E_OK){
+                status = LZO_E_ERROR;
+            }
+            free(path);
+        } else if (S_ISREG(st.st_mode) && strcmp(getExt(entry->d_name), ".plzo") != 0){
+            add_file(list, path, st.st_size);
+        } else {
+            free(path);
+        }
+    }
+    closedir(dir);
+    return status;
 }
-const char *getExt (const char *fspec) {
-    char *e = strrchr (fspec, '.');
-    if (e == NULL)
-        e = "";
-    return e;
-}
-struct result_s compress_data_parallel(char filename[]){
-    struct result_s result;
-    clock_t start;
+//cuts the data of a file into block_size chunks
+static void cut_file(struct file_job_s *f){
     int c;
-    if (thread_count == 0){
-        thread_count = 8;
-    }
-    FILE *infile = fopen(filename, "rb");
-    char *ext = (char *) getExt(filename);
-    char *outfilename;
-    int cmp = strcmp(ext, "");
-    if (cmp == 0){
-        outfilename = (char *) xmalloc(strlen(filename) + 5);
-        strcpy(outfilename, filename);
-        strcat(outfilename, ".plzo");
-    } else if (cmp > 0){
-        outfilename = (char *) xmalloc(strlen(filename) + 1);
-        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
-        outfilename[strlen(filename) - strlen(ext)] = '\0';
-        strcat(outfilename, "plzo");
+    f->count = (f->in_len + block_size - 1) / block_size;
+    for (c = 0; c < f->count; c++){
+        f->blocks[c].data = f->data + c * block_size;
+        f->blocks[c].data_size = c == f->count - 1 ? f->in_len - c * block_size : block_size;
     }
-    FILE *outfile = fopen(outfilename, "wb");
-    fwrite(&thread_count, sizeof(char), 1, outfile);
-    fseek(infile, 0, SEEK_END);
-    lzo_uint in_len = ftell(infile);
-    rewind(infile);
-    lzo_uint data_c_size = in_len / thread_count;
-    lzo_uint comp_c_size = data_c_size + data_c_size / 16 + 64 + 3;
-    fwrite(&data_c_size, sizeof(unsigned long int), 1, outfile);
-    char complimentary = in_len % thread_count;
-    fwrite(&complimentary, sizeof(char), 1, outfile);
-    struct arg_s args[thread_count];
-    pthread_t threads[thread_count];
-    for (c = 0; c < thread_count; c++){
-        if (c == thread_count - 1){
-            data_c_size += complimentary;
-        }
-        args[c].data = (lzo_bytep) xmalloc(data_c_size);
-        args[c].out = (lzo_bytep) xmalloc(comp_c_size);
-        args[c].data_size = data_c_size;
-        args[c].out_size = comp_c_size;
-		fread(args[c].data, 1, args[c].data_size, infile);
+}
+//reads a file and submits it in block_size chunks
+bool start_file(struct file_job_s *f){
+    FILE *infile = fopen(f->name, "rb");
+    if (infile == NULL){
+        printf("cannot open %s\n", f->name);
+        return false;
     }
-    start = clock();
-    for (c = 0; c < thread_count; c++){
-        pthread_create(&threads[c], NULL, compress, (void *) &args[c]);
+    f->data = (lzo_bytep) plzo_buffer_get(f->in_len + 1);
+    f->blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * ((f->in_len + block_size - 1) / block_size + 1));
+    cut_file(f);
+    lzo_uint out_len = plzo_batch_bound(PLZO_COMPRESS, f->blocks, f->count);
+    f->out = (lzo_bytep) plzo_buffer_get(out_len + 1);
+    if (numa){ // the pages of each block land on the node that compresses it, the read only fills them
+        plzo_batch(pool, PLZO_TOUCH, f->blocks, f->count, f->out, out_len);
     }
-    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
-    FILE *temp = tmpfile();
-    unsigned int sizes[thread_count];
-    for (c = 0; c < thread_count; c++){
-        pthread_join(threads[c], NULL);
-        fwrite(args[c].out, 1, args[c].out_size, temp);
-        sizes[c] = ftell(temp);
-        rewind(temp);
+    unsigned long long trace = plzo_trace_begin();
+    lzo_uint expected = f->in_len;
+    f->in_len = fread(f->data, 1, f->in_len, infile);
+    plzo_trace_end("read", trace, 0, -1, f->in_len);
+    fclose(infile);
+    if (f->in_len != expected){ // the file shrank since it was listed
+        cut_file(f);
     }
-    fclose(temp);
-    fwrite(sizes, sizeof(unsigned int), thread_count, outfile);
-    for (c = 0; c < thread_count; c++){
-        fwrite(args[c].out, 1, args[c].out_size, outfile);
-        free(args[c].data);
-        free(args[c].out);
+    f->job = plzo_batch_submit(pool, PLZO_COMPRESS | PLZO_CHECKSUM | PLZO_RESERVED, f->blocks, f->count, f->out, out_len, NULL, NULL);
+    return true;
+}
+//waits for a submitted file and writes name.plzo next to it, returns the first error
+int finish_file(struct file_job_s *f){
+    int r = plzo_wait(f->job);
+    plzo_release(f->job);
+    if (r != LZO_E_OK){
+        printf("parallel comp error %d - %s\n", r, f->name);
+    } else {
+        char *outfilename = (char *) xmalloc(strlen(f->name) + 6);
+        strcpy(outfilename, f->name);
+        strcat(outfilename, ".plzo");
+        FILE *outfile = fopen(outfilename, "wb");
+        if (outfile == NULL){
+            printf("cannot create %s\n", outfilename);
+            r = LZO_E_ERROR;
+        } else {
+            r = plzo_file_write(outfile, f->name, f->blocks, f->count);
+            if (fclose(outfile) != 0 && r == LZO_E_OK){
+                r = LZO_E_ERROR;
+            }
+            if (r != LZO_E_OK){
+                printf("write error - %s\n", outfilename);
+            }
+        }
+        free(outfilename);
     }
-    result.in_size = in_len;
-    result.out_size = ftell(outfile);
-    result.ratio = (double) result.out_size / result.in_size;
-    fclose(outfile);
-    fclose(infile);
-    free(wrkmem);
-    return result;
+    plzo_buffer_put(f->data);
+    plzo_buffer_put(f->out);
+    free(f->blocks);
+    plzo_memory_release(f->held);
+    return r;
 }
-struct result_s decompress_data_parallel(char filename[]){
-    struct result_s result;
-    clock_t start;
-    int c;
-    if (thread_count == 0){
-        thread_count = 8;
+//budget of a file held whole in memory with the bound of its compressed blocks
+static unsigned long long file_bytes(lzo_uint in_len){
+    unsigned long long count = (in_len + block_size - 1) / block_size;
+    return plzo_buffer_bytes(in_len + 1) + plzo_buffer_bytes(in_len + in_len / 16 + 67 * (count ? count : 1) + 1);
+}
+//compresses a file larger than half the memory budget one window of blocks at a time
+static int compress_windowed(struct file_job_s *f){
+    int r = LZO_E_ERROR;
+    FILE *infile = fopen(f->name, "rb");
+    if (infile == NULL){
+        printf("cannot open %s\n", f->name);
+        return LZO_E_ERROR;
     }
-    FILE *infile = fopen(filename, "rb");
-    fseek(infile, 0, SEEK_END);
-    unsigned int length = ftell(infile);
-    rewind(infile);
-    char *ext = (char *) getExt(filename);
-    char *outfilename = (char *) xmalloc(strlen(filename) + 5);
-    strncpy(outfilename, filename, strlen(filename) - strlen(ext));
-    outfilename[strlen(filename) - strlen(ext)] = '\0';
-    strcat(outfilename, "_dp");
+    char *outfilename = (char *) xmalloc(strlen(f->name) + 6);
+    strcpy(outfilename, f->name);
+    strcat(outfilename, ".plzo");
     FILE *outfile = fopen(outfilename, "wb");
-    char t_count;
-    fread(&t_count, sizeof(char), 1, infile);
-    lzo_uint data_c_size = (lzo_uint) xmalloc(sizeof(unsigned long int));
-    fread(&data_c_size, sizeof data_c_size, 1, infile);
-    char complimentary;
-    fread(&complimentary, sizeof(char), 1, infile);
-    unsigned int *comp_c_sizes[t_count];
-    for (c = 0; c < thread_count; c++){
-        comp_c_sizes[c] = malloc(sizeof(unsigned int));
-        fread(comp_c_sizes[c], sizeof(unsigned int), 1, infile);
-    }
-    struct arg_s args[thread_count];
-    pthread_t threads[thread_count];
-    for (c = 0; c < thread_count; c++){
-        if (c == thread_count - 1){
-            data_c_size += complimentary;
+    if (outfile == NULL){
+        printf("cannot create %s\n", outfilename);
+    } else {
+        r = plzo_file_compress(pool, infile, outfile, f->name, block_size);
+        if (fclose(outfile) != 0 && r == LZO_E_OK){
+            r = LZO_E_ERROR;
+        }
+        if (r != LZO_E_OK){
+            printf("parallel comp error %d - %s\n", r, f->name);
         }
-        args[c].data = (lzo_bytep) xmalloc(*comp_c_sizes[c]);
-        args[c].out = (lzo_bytep) xmalloc(data_c_size);
-        args[c].data_size = *comp_c_sizes[c];
-        args[c].out_size = data_c_size;
-        fread(args[c].data, 1, *comp_c_sizes[c], infile);
-    }
-    start = clock();
-    for (c = 0; c < thread_count; c++){
-        pthread_create(&threads[c], NULL, decompress, (void *) &args[c]);
     }
-    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    free(outfilename);
     fclose(infile);
-    for (c = 0; c < thread_count; c++){
-        pthread_join(threads[c], NULL);
-        fwrite(args[c].out, 1, args[c].out_size, outfile);
-        free(args[c].data);
-        free(args[c].out);
-    }
-    result.in_size = length;
-    result.out_size = ftell(outfile);
-    result.ratio = (double) result.out_size / result.in_size;
-    fclose(outfile);
-    return result;
+    return r;
 }
-struct result_s compress_data_serial(char filename[]){
-    struct result_s result;
-    clock_t start;
-    wrkmem = (lzo_voidp) xmalloc(LZO1X_1_MEM_COMPRESS);
-    FILE *infile = fopen(filename, "rb");
-    fseek(infile, 0, SEEK_END);
-    lzo_uint in_len = ftell(infile);
-    rewind(infile);
-    lzo_bytep data = (lzo_bytep) xmalloc(in_len);
-    fread(data, 1, in_len, infile);
-    fclose(infile);
-    lzo_uint out_len = in_len + in_len / 16 + 64 + 3;
-    lzo_bytep out = (lzo_bytep) xmalloc(out_len);
-    start = clock();
-    int r = lzo1x_1_compress(data, in_len, out, &out_len, wrkmem);
-    if (r != LZO_E_OK){
-        printf("serial comp error %d\n", r);
+//compresses all files concurrently on the pool, keeping a bounded number of them in memory, returns
+//LZO_E_OK if every file was written
+int compress_files(struct file_list_s *list){
+    int max_files = 4 * thread_count;
+    lzo_uint max_bytes = 64 * block_size * thread_count;
+    lzo_uint in_flight = 0;
+    int first = 0; // oldest file not written yet
+    int status = LZO_E_OK;
+    int c;
+    for (c = 0; c < list->count; c++){
+        struct file_job_s *f = &list->files[c];
+        unsigned long long need = file_bytes(f->in_len);
+        bool windowed = plzo_memory_limit() != 0 && need > plzo_memory_limit() / 2;
+        bool admitted = false;
+        //a windowed file runs after all others, its windows take the budget they leave
+        while (first < c){
+            if (!windowed && c - first < max_files && in_flight + f->in_len <= max_bytes && plzo_memory_try_acquire(need)){
+                admitted = true;
+                break;
+            }
+            if (list->files[first].job != NULL){
+                if (finish_file(&list->files[first]) != LZO_E_OK){
+                    status = LZO_E_ERROR;
+                }
+                in_flight -= list->files[first].in_len;
+            }
+            first++;
+        }
+        f->job = NULL;
+        f->held = 0;
+        if (windowed){
+            if (compress_windowed(f) != LZO_E_OK){
+                status = LZO_E_ERROR;
+            }
+            continue;
+        }
+        if (!admitted && plzo_memory_acquire(need) != LZO_E_OK){
+            printf("%s does not fit the memory budget\n", f->name);
+            status = LZO_E_ERROR;
+            continue;
+        }
+        if (start_file(f)){
+            f->held = need;
+            in_flight += f->in_len;
+        } else {
+            plzo_memory_release(need);
+            status = LZO_E_ERROR;
+        }
     }
-    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
-    char outfilename[strlen(filename) + 4];
-    char *ext = (char *) getExt(filename);
-    int cmp = strcmp(ext, "");
-    if (cmp == 0){
-        strcpy(outfilename, filename);
-        strcat(outfilename, ".lzo");
-    } else if (cmp > 0){
-        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
-        outfilename[strlen(filename) - strlen(ext)] = '\0';
-        strcat(outfilename, "lzo");
+    for (; first < list->count; first++){
+        if (list->files[first].job != NULL && finish_file(&list->files[first]) != LZO_E_OK){
+            status = LZO_E_ERROR;
+        }
     }
-    FILE *outfile = fopen(outfilename, "wb");
-    fwrite(out, 1, out_len, outfile);
-    fclose(outfile);
-    free(data);
-    free(out);
-    result.in_size = in_len;
-    result.out_size = out_len;
-    result.ratio = (double) result.out_size / result.in_size;
-    free(wrkmem);
-    return result;
+    return status;
 }
-struct result_s decompress_data_serial(char filename[]){
-    struct result_s result;
-    clock_t start;
-    FILE *infile = fopen(filename, "rb");
-    fseek(infile, 0, SEEK_END);
-    lzo_uint in_len = ftell(infile);
-    rewind(infile);
-    lzo_bytep data = (lzo_bytep) malloc(in_len);
-    fread(data, 1, in_len, infile);
-    fclose(infile);
-    lzo_uint out_len = in_len * 16;
-    lzo_bytep out = (lzo_bytep) malloc(out_len);
-    start = clock();
-    int r = lzo1x_decompress(data, in_len, out, &out_len, NULL);
-    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
-    if (r != LZO_E_OK){
-        printf("serial decomp error %d\n", r);
+void usage(void){
+    printf("usage: %s [-t threads] [-b block-size] [-r] file|dir...\n", progname);
+    printf("       %s [-t threads] [-b block-size] -a archive file|dir...\n", progname);
+    printf("       %s [-t threads] [-b block-size] --append file.plzo [file|-]...\n", progname);
+    printf("       %s [-t threads] [-b block-size] --append archive.plza file|dir...\n", progname);
+    printf("       %s -l archive\n", progname);
+    printf("       %s [-t threads] -x archive [member...]\n", progname);
+    printf("       %s [-t threads] [-b block-size]      run the Calgary Corpus benchmark\n", progname);
+    printf("       %s [-t max-threads] [-b block-size] [options] bench scale [file...]\n", progname);
+    printf("       %s [-t threads] [--min-block SIZE] [--max-block SIZE] [options] bench blocks [file...]\n", progname);
+    printf("       %s [-t threads] [-b block-size] [options] bench mem [file...]\n", progname);
+    printf("       %s [-t threads] [-b block-size] [options] bench sched [file...]\n", progname);
+    printf("       %s [-t threads] [-b block-size] [options] bench pages [file...]\n", progname);
+    printf("       %s [--seed N] bench gen text|binary|random|zero|mixed SIZE [file]\n", progname);
+    printf("  -t N     number of worker threads (default: the cpus of the affinity mask or --cpus, at most\n");
+    printf("           the cgroup cpu quota)\n");
+    printf("  -b SIZE  chunk size for large files, K/M/G suffixes allowed, at most 3840M (default 1M, 64K for\n");
+    printf("           Calgary)\n");
+    printf("  -r       compress directories recursively\n");
+    printf("  -a FILE  create a .plza archive, directories are always walked\n");
+    printf("  --append FILE\n");
+    printf("           add data to FILE, creating it if needed: a .plza gets new members, any other\n");
+    printf("           file gets the data (stdin without operands) at the end of its last member\n");
+    printf("  -l FILE  list the members of an archive\n");
+    printf("  -x FILE  extract all or the named members of an archive\n");
+    printf("  --numa   spread the workers over the NUMA nodes, bound to their cpus, give each node a range\n");
+    printf("           of every job and place the buffers of those blocks on it by first touch\n");
+    printf("  --cpus LIST\n");
+    printf("           pin each worker to one cpu of LIST (e.g. 4-15,32-47) in turn, within the affinity mask\n");
+    printf("  --io-cpus LIST\n");
+    printf("           read and write on the cpus of LIST and keep the workers off them\n");
+    printf("  --huge-pages small|thp|hugetlb\n");
+    printf("           back work memory and block buffers of 64K and more with transparent huge pages or\n");
+    printf("           reserved hugetlb pages, falling back to thp and then small pages (default small)\n");
+    printf("  --max-memory SIZE\n");
+    printf("           keep work memory and block buffers within SIZE: files, members and streams wait until\n");
+    printf("           they fit and files too large for half of it are compressed and extracted in windows\n");
+    printf("  --trace FILE\n");
+    printf("           record read, compress, checksum, write and wait spans of every block and thread\n");
+    printf("           as a Chrome trace (chrome://tracing, ui.perfetto.dev)\n");
+    printf("benchmark options, benchmarks also take @kind:size (e.g. @mixed:256M) in place of a file:\n");
+    printf("  -n N     least timed runs per benchmark point (default 5)\n");
+    printf("  --warmup N, --ci PERCENT, --max-runs N\n");
+    printf("           untimed runs before each point (default 1), then runs continue until the 95%%\n");
+    printf("           confidence interval is within PERCENT of the mean (default 2) or N runs (default 50)\n");
+    printf("  --min-block SIZE, --max-block SIZE\n");
+    printf("           block size range of bench blocks (default 16K to 64M)\n");
+    printf("  --seed N seed of synthetic inputs\n");
+    printf("  --perf   count cycles, instructions, cache, branch and TLB misses of every worker\n");
+    printf("  --workers\n");
+    printf("           print busy, cpu and idle time of every worker and the imbalance (max/mean busy)\n");
+    printf("  --exec pool|openmp|serial\n");
+    printf("           run the blocks of the Calgary driver and the benchmarks on the worker pool (default),\n");
+    printf("           an OpenMP team (needs plzo_exec.c built with -fopenmp) or the calling thread\n");
+    printf("  --format json|csv\n");
+    printf("           also write every timed run of a benchmark with host and build information\n");
+    printf("  --output FILE\n");
+    printf("           where --format writes to, - for stdout (default results_bench.json or .csv)\n");
+}
+static void stop_trace(void){
+    plzo_trace_stop();
+}
+//prints the central directory of an archive
+int list_archive(const char *archive_name){
+    int c;
+    plzo_archive *archive = plzo_archive_open(archive_name);
+    if (archive == NULL){
+        printf("%s is not a plzo archive\n", archive_name);
+        return 1;
     }
-    char outfilename[strlen(filename) + 4];
-    char *ext = (char *) getExt(filename);
-    int cmp = strcmp(ext, "");
-    if (cmp == 0){
-        strcpy(outfilename, filename);
-        strcat(outfilename, "_ds");
-    } else if (cmp > 0) {
-        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
-        outfilename[strlen(filename) - strlen(ext)] = '\0';
-        strcat(outfilename, "_ds");
+    printf("%15s\t%10s\t%8s\t%s\n", "size", "blocks", "adler32", "name");
+    for (c = 0; c < plzo_archive_count(archive); c++){
+        const struct plzo_entry_s *e = plzo_archive_entry(archive, c);
+        printf("%15llu\t%10lu\t%08x\t%s\n", e->size, e->block_count, (unsigned int) e->checksum, e->name);
     }
-    FILE *outfile = fopen(outfilename, "wb");
-    fwrite(out, 1, out_len, outfile);
-    fclose(outfile);
-    free(data);
-    free(out);
-    result.in_size = in_len;
-    result.out_size = out_len;
-    result.ratio = (double) result.out_size / result.in_size;
-    return result;
+    plzo_archive_close(archive);
+    return 0;
 }
-bool test_file_integrity(char filename[]){
-    FILE *original_file = fopen(filename, "rb");
-    char *decompressed_filename = (char *) xmalloc(strlen(filename) + 4);
-    strcpy(decompressed_filename, filename);
-    strcat(decompressed_filename, "_dp");
-    FILE *decompressed_file = fopen(decompressed_filename, "rb");
-    fseek(original_file, 0, SEEK_END);
-    long int original_size = ftell(original_file);
-    fseek(decompressed_file, 0, SEEK_END);
-    long int decompressed_size = ftell(decompressed_file);
-    if (original_size != decompressed_size){
-        printf("file sizes do not match - %s and %s\n", filename, decompressed_filename);
-        return false;
+int main(int argc, char *argv[]){
+    int opt;
+    bool recursive = false;
+    char *archive_name = NULL;
+    char mode = 0; // a, A (append), l or x when working on an archive
+    bool threads_set = false;
+    bool block_set = false;
+    char *format = NULL; // json or csv report of the benchmarks
+    char *output = NULL;
+    char *trace = NULL; // chrome trace of every block
+    unsigned long long max_memory = 0;
+    struct bench_options_s bench;
+    memset(&bench, 0, sizeof bench);
+    bench.warmup = 1;
+    bench.seed = CORPUS_SEED;
+    bench.max_runs = 50;
+    static const struct option long_options[] = {
+        {"append", required_argument, NULL, 'A'},
+        {"format", required_argument, NULL, 'F'},
+        {"output", required_argument, NULL, 'o'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"seed", required_argument, NULL, 'S'},
+        {"ci", required_argument, NULL, 'c'},
+        {"max-runs", required_argument, NULL, 'R'},
+        {"min-block", required_argument, NULL, 'm'},
+        {"max-block", required_argument, NULL, 'M'},
+        {"perf", no_argument, NULL, 'P'},
+        {"workers", no_argument, NULL, 'W'},
+        {"trace", required_argument, NULL, 'T'},
+        {"exec", required_argument, NULL, 'E'},
+        {"numa", no_argument, NULL, 'N'},
+        {"cpus", required_argument, NULL, 'C'},
+        {"io-cpus", required_argument, NULL, 'I'},
+        {"huge-pages", required_argument, NULL, 'H'},
+        {"max-memory", required_argument, NULL, 'L'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    progname = argv[0];
+    while ((opt = getopt_long(argc, argv, "t:b:n:ra:l:x:h", long_options, NULL)) != -1){
+        switch (opt){
+        case 't':
+            thread_count = atoi(optarg);
+            threads_set = true;
+            break;
+        case 'n':
+            bench.repeat = atoi(optarg);
+            break;
+        case 'w':
+            bench.warmup = atoi(optarg);
+            break;
+        case 'S':
+            bench.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            bench.ci = atof(optarg) / 100;
+            break;
+        case 'R':
+            bench.max_runs = atoi(optarg);
+            break;
+        case 'F':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'm':
+            bench.min_block = bench_parse_size(optarg);
+            break;
+        case 'M':
+            bench.max_block = bench_parse_size(optarg);
+            break;
+        case 'P':
+            bench.perf = true;
+            break;
+        case 'W':
+            bench.workers = true;
+            break;
+        case 'N':
+            numa = true;
+            bench.numa = true;
+            break;
+        case 'C':
+            cpus = optarg;
+            bench.cpus = optarg;
+            break;
+        case 'I':
+            io_cpus = optarg;
+            break;
+        case 'H':
+            if (plzo_page_kind(optarg) < 0){
+                printf("unknown page kind %s\n", optarg);
+                return 1;
+            }
+            plzo_set_pages(plzo_page_kind(optarg)); // before any pool allocates its work memory
+            break;
+        case 'L':
+            max_memory = bench_parse_size(optarg);
+            if (max_memory == 0){
+                printf("bad memory limit %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            trace = optarg;
+            break;
+        case 'E':
+            bench.exec = plzo_exec_kind(optarg);
+            if (bench.exec < 0){
+                printf("unknown executor %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            if (bench_parse_size(optarg) > PLZO_MAX_BLOCK_SIZE){ // would not fit the 32 bit lengths of the file formats
+                printf("block size %s is larger than %lluM\n", optarg, PLZO_MAX_BLOCK_SIZE >> 20);
+                return 1;
+            }
+            block_size = bench_parse_size(optarg);
+            block_set = true;
+            break;
+        case 'r':
+            recursive = true;
+            break;
+        case 'a':
+        case 'A':
+        case 'l':
+        case 'x':
+            mode = (char) opt;
+            archive_name = optarg;
+            break;
+        default:
+            usage();
+            return opt == 'h' ? 0 : 1;
+        }
     }
-    rewind(original_file);
-    rewind(decompressed_file);
-    // compare byte by byte
-    char original_byte;
-    char decompressed_byte;
-    while (fread(&original_byte, 1, 1, original_file) == 1){
-        fread(&decompressed_byte, 1, 1, decompressed_file);
-        if (original_byte != decompressed_byte){
-            printf("file contents do not match - %s and %s\n", filename, decompressed_filename);
-            return false;
+    if ((threads_set && thread_count < 1) || block_size == 0){
+        usage();
+        return 1;
+    }
+    //read before any thread is bound, the lists stay within the mask the process started with
+    const char *lists[2] = {cpus, io_cpus};
+    for (opt = 0; opt < 2; opt++){
+        if (lists[opt] != NULL && plzo_cpu_count(lists[opt]) <= 0){
+            printf("%s: %s\n", lists[opt], plzo_cpu_count(lists[opt]) < 0 ? "not a cpu list" : "none of these cpus may be used");
+            return 1;
         }
     }
-    fclose(original_file);
-    fclose(decompressed_file);
-    return true;
-}
-int main(){
+    if (!threads_set){ // a 2 cpu container gets 2 workers, a 64 core machine 64
+        thread_count = plzo_cpu_threads(cpus);
+    }
     //checks if the lzo can be initialized
     if (lzo_init() != LZO_E_OK){
         printf("lzo init failed\n");
         return 1;
     }
-    printf("Parallel LZO compression & decompression test using Calgary Corpus and some other big files\n");
-    char filenames[22][20] = {"trans","paper4","paper3","news","paper2","book1","geo","obj2","paper1","progp","paper5","pic","paper6","progc","progl","bib","obj1","book2", "big1", "big4", "book3", "html"};
-    struct result_s results_s[22][2]; // 0 for compression, 1 for decompression
-    struct result_s results_p[22][2]; // 0 for compression, 1 for decompression
-    for (int tempcount = 0; tempcount < 22; tempcount++){
-        results_s[tempcount][0].in_size = 0;
-        results_s[tempcount][0].out_size = 0;
-        results_s[tempcount][0].ratio = 0;
-        results_s[tempcount][0].time = 0;
-        results_s[tempcount][1].in_size = 0;
-        results_s[tempcount][1].out_size = 0;
-        results_s[tempcount][1].ratio = 0;
-        results_s[tempcount][1].time = 0;
-        results_p[tempcount][0].in_size = 0;
-        results_p[tempcount][0].out_size = 0;
-        results_p[tempcount][0].ratio = 0;
-        results_p[tempcount][0].time = 0;
-        results_p[tempcount][1].in_size = 0;
-        results_p[tempcount][1].out_size = 0;
-        results_p[tempcount][1].ratio = 0;
-        results_p[tempcount][1].time = 0;
+    if (mode == 'l'){
+        return list_archive(archive_name);
     }
-    int j;
-    double sumtime = 0;
-    double sumratio = 0;
-    for (j = 0; j < 22; j++) { // for each file in the corpus do the following
-        sumtime = 0;
-        sumratio = 0;
-        char *temp;
-        printf("file is %s\n", filenames[j]);
-        for (int i = 0; i < 10; i++){
-            results_s[j][0] = compress_data_serial(filenames[j]); // compress the file using serial compression
-            sumtime += results_s[j][0].time;
-            sumratio += results_s[j][0].ratio;
+    if (trace != NULL){ // written at exit, after every pool is gone
+        if (plzo_trace_start(trace) != LZO_E_OK){
+            return 1;
         }
-        results_s[j][0].time = sumtime / 10;
-        results_s[j][0].ratio = sumratio / 10;
-        sumratio = 0;
-        sumtime = 0;
-        printf("s comp %d done\n", j);
-        temp = (char *) xmalloc(strlen(filenames[j]) + 4);
-        strcpy(temp, filenames[j]);
-        strcat(temp, ".lzo");
-        for (int i = 0; i < 10; i++){
-            results_s[j][1] = decompress_data_serial(temp); // decompress the file using serial decompression
-            sumtime += results_s[j][1].time;
-            sumratio += results_s[j][1].ratio;
+        atexit(stop_trace);
+    }
+    if (mode == 0 && optind < argc && strcmp(argv[optind], "bench") == 0){
+        bench.threads = threads_set ? thread_count : 0; // plzo_cpu_threads() unless -t is given
+        bench.block_size = block_size;
+        char **names = optind + 2 < argc ? argv + optind + 2 : calgary_files;
+        int count = optind + 2 < argc ? argc - optind - 2 : CALGARY_FILES;
+        int r;
+        if (format != NULL && bench_report_start(format, output, &bench, argc, argv) != LZO_E_OK){
+            return 1;
         }
-        results_s[j][1].time = sumtime / 10;
-        results_s[j][1].ratio = sumratio / 10;
-        sumratio = 0;
-        sumtime = 0;
-        printf("s decomp %d done\n", j);
-        free(temp);
-        for (int i = 0; i < 10; i++){
-            results_p[j][0] = compress_data_parallel(filenames[j]); // compress the file using parallel compression
-            sumtime += results_p[j][0].time;
-            sumratio += results_p[j][0].ratio;
+        if (optind + 1 < argc && strcmp(argv[optind + 1], "gen") == 0){
+            int kind = optind + 2 < argc ? corpus_kind(argv[optind + 2]) : -1;
+            if (kind < 0 || optind + 3 >= argc){
+                usage();
+                return 1;
+            }
+            return corpus_write(kind, bench.seed, bench_parse_size(argv[optind + 3]),
+                                optind + 4 < argc ? argv[optind + 4] : NULL) == LZO_E_OK ? 0 : 1;
         }
-        results_p[j][0].time = sumtime / 10;
-        results_p[j][0].ratio = sumratio / 10;
-        sumratio = 0;
-        sumtime = 0;
-        printf("p comp %d done\n", j);
-        temp = (char *) xmalloc(strlen(filenames[j]) + 5);
-        strcpy(temp, filenames[j]);
-        strcat(temp, ".plzo");
-        for (int i = 0; i < 10; i++){
-            results_p[j][1] = decompress_data_parallel(temp); // decompress the file using parallel decompression
-            sumtime += results_p[j][1].time;
-            sumratio += results_p[j][1].ratio;
+        if (optind + 1 < argc && strcmp(argv[optind + 1], "scale") == 0){
+            r = bench_scale(&bench, names, count);
+        } else if (optind + 1 < argc && strcmp(argv[optind + 1], "mem") == 0){
+            r = bench_mem(&bench, names, count);
+        } else if (optind + 1 < argc && strcmp(argv[optind + 1], "blocks") == 0){
+            r = bench_blocks(&bench, names, count);
+        } else if (optind + 1 < argc && strcmp(argv[optind + 1], "sched") == 0){
+            r = bench_sched(&bench, names, count);
+        } else if (optind + 1 < argc && strcmp(argv[optind + 1], "pages") == 0){
+            r = bench_pages(&bench, names, count);
+        } else {
+            usage();
+            return 1;
         }
-        results_p[j][1].time = sumtime / 10;
-        results_p[j][1].ratio = sumratio / 10;
-        free(temp);
-        if (test_file_integrity(filenames[j]) == false){
-            printf("file integrity test failed at file %d - %s\n", j, filenames[j]);
+        if (bench_report_finish() != LZO_E_OK){
+            r = LZO_E_ERROR;
         }
+        return r == LZO_E_OK ? 0 : 1;
     }
-    char results_filename[100] = "results_pthread_actual_";
-    // concat the thread count to the filename
-    char thread_count_str[2];
-    sprintf(thread_count_str, "%d", (int) thread_count);
-    strcat(results_filename, thread_count_str);
-    strcat(results_filename, "_threads.txt");
-    FILE *results_file = fopen(results_filename, "wb");
-    fprintf(results_file, "%-30s\t%15s\t%15s\t%15s\t%15s\t%15s\t%15s\t%15s\n\n", "filename", "file-size", "comp-size", "comp-ratio", "comp-time", "decomp-size", "decomp-ratio", "decomp-time");
-    for (j = 0; j < 22; j++){
-        fprintf(results_file, "%-30s\n", filenames[j]);
-        fprintf(results_file, "%30s\t", "serial");
-        char file_size[20];
-        sprintf(file_size, "%15.4lu", results_s[j][0].in_size);
-        fwrite(file_size, 1, strlen(file_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char comp_size[20];
-        sprintf(comp_size, "%15.4lu", results_s[j][0].out_size);
-        fwrite(comp_size, 1, strlen(comp_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char comp_ratio[20];
-        sprintf(comp_ratio, "%15.8f", results_s[j][0].ratio);
-        fwrite(comp_ratio, 1, strlen(comp_ratio), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char comp_time[20];
-        sprintf(comp_time, "%15.8f", results_s[j][0].time);
-        fwrite(comp_time, 1, strlen(comp_time), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char decomp_size[20];
-        sprintf(decomp_size, "%15.4lu", results_s[j][1].out_size);
-        fwrite(decomp_size, 1, strlen(decomp_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char decomp_ratio[20];
-        sprintf(decomp_ratio, "%15.8f", results_s[j][1].ratio);
-        fwrite(decomp_ratio, 1, strlen(decomp_ratio), results_file);
-        fwrite("\t", 1, 1, results_file);
-        char decomp_time[20];
-        sprintf(decomp_time, "%15.8f", results_s[j][1].time);
-        fwrite(decomp_time, 1, strlen(decomp_time), results_file);
-        fwrite("\n", 1, 1, results_file);
-        fprintf(results_file, "%30s\t", "parallel");
-        sprintf(file_size, "%15.4lu", results_p[j][0].in_size);
-        fwrite(file_size, 1, strlen(file_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(comp_size, "%15.4lu", results_p[j][0].out_size);
-        fwrite(comp_size, 1, strlen(comp_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(comp_ratio, "%15.8f", results_p[j][0].ratio);
-        fwrite(comp_ratio, 1, strlen(comp_ratio), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(comp_time, "%15.8f", results_p[j][0].time);
-        fwrite(comp_time, 1, strlen(comp_time), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(decomp_size, "%15.4lu", results_p[j][1].out_size);
-        fwrite(decomp_size, 1, strlen(decomp_size), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(decomp_ratio, "%15.8f", results_p[j][1].ratio);
-        fwrite(decomp_ratio, 1, strlen(decomp_ratio), results_file);
-        fwrite("\t", 1, 1, results_file);
-        sprintf(decomp_time, "%15.8f", results_p[j][1].time);
-        fwrite(decomp_time, 1, strlen(decomp_time), results_file);
-        fwrite("\n\n", 2, 1, results_file);
+    if (max_memory != 0){ // the work memory of the workers stays allocated, the rest is for block buffers
+        unsigned long long work = thread_count * plzo_buffer_bytes(LZO1X_1_MEM_COMPRESS);
+        if (mode == 'x' && max_memory <= work){ // extraction sizes its windows from the blocks of the archive
+            printf("--max-memory needs more than %lluK for %d threads\n", (work + 1023) / 1024, thread_count);
+            return 1;
+        }
+        unsigned long long least = work + 4 * (plzo_buffer_bytes(block_size) + plzo_buffer_bytes(PLZO_COMPRESS_BOUND(block_size)));
+        if (mode != 'x' && max_memory < least){
+            printf("--max-memory needs at least %lluK for %d threads and %luK blocks\n", (least + 1023) / 1024,
+                   thread_count, (unsigned long) (block_size / 1024));
+            return 1;
+        }
+        plzo_set_memory_limit(max_memory - work);
+    }
+    struct plzo_pool_options_s pool_options;
+    memset(&pool_options, 0, sizeof pool_options);
+    pool_options.numa = numa;
+    pool_options.cpus = cpus;
+    pool_options.avoid = io_cpus;
+    pool = plzo_pool_create_with(thread_count, &pool_options);
+    if (io_cpus != NULL && plzo_cpu_bind(io_cpus) != LZO_E_OK){ // after the pool, whose workers would inherit it
+        printf("cannot bind to --io-cpus %s\n", io_cpus);
+    }
+    if (mode == 'x'){
+        plzo_archive *archive = plzo_archive_open(archive_name);
+        if (archive == NULL){
+            printf("%s is not a plzo archive\n", archive_name);
+            return 1;
+        }
+        int r = plzo_archive_extract(pool, archive, argv + optind, argc - optind);
+        plzo_archive_close(archive);
+        plzo_pool_destroy(pool);
+        return r == LZO_E_OK ? 0 : 1;
+    }
+    if (mode == 'A' && strcmp(getExt(archive_name), ".plza") != 0){ // grow the last member with raw data
+        char *stdin_name[] = {"-"};
+        int r;
+        if (optind < argc){
+            r = plzo_archive_append(pool, archive_name, argv + optind, argc - optind, block_size, 0);
+        } else {
+            r = plzo_archive_append(pool, archive_name, stdin_name, 1, block_size, 0);
+        }
+        plzo_pool_destroy(pool);
+        return r == LZO_E_OK ? 0 : 1;
+    }
+    if ((mode == 'a' || mode == 'A') && optind == argc){
+        usage();
+        plzo_pool_destroy(pool);
+        return 1;
+    }
+    if (optind < argc){ // files on the command line, compress them instead of running the benchmark
+        struct file_list_s list = {NULL, 0, 0};
+        struct stat st;
+        int r = LZO_E_OK; // operands that cannot be read fail the run, the others are still compressed
+        for (; optind < argc; optind++){
+            if (stat(argv[optind], &st) != 0){
+                printf("cannot open %s\n", argv[optind]);
+                r = LZO_E_ERROR;
+            } else if (S_ISDIR(st.st_mode)){
+                if (!recursive && mode != 'a' && mode != 'A'){
+                    printf("%s is a directory, use -r\n", argv[optind]);
+                    r = LZO_E_ERROR;
+                } else if (walk_tree(argv[optind], &list) != LZO_E_OK){
+                    r = LZO_E_ERROR;
+                }
+            } else {
+                add_file(&list, strdup(argv[optind]), st.st_size);
+            }
+        }
+        int status = LZO_E_OK;
+        if (mode == 'a'){
+            char **names = (char **) xmalloc(sizeof(char *) * (list.count ? list.count : 1));
+            for (opt = 0; opt < list.count; opt++){
+                names[opt] = list.files[opt].name;
+            }
+            status = plzo_archive_create(pool, archive_name, names, list.count, block_size);
+            free(names);
+        } else if (mode == 'A'){
+            char **names = (char **) xmalloc(sizeof(char *) * (list.count ? list.count : 1));
+            for (opt = 0; opt < list.count; opt++){
+                names[opt] = list.files[opt].name;
+            }
+            status = plzo_archive_append(pool, archive_name, names, list.count, block_size, 1);
+            free(names);
+        } else {
+            status = compress_files(&list);
+        }
+        if (status != LZO_E_OK){
+            r = status;
+        }
+        for (opt = 0; opt < list.count; opt++){
+            free(list.files[opt].name);
+        }
+        free(list.files);
+        plzo_pool_destroy(pool);
+        return r == LZO_E_OK ? 0 : 1;
+    }
+    plzo_pool_destroy(pool); // the Calgary driver runs on its own executor
+    bench.threads = thread_count;
+    bench.block_size = block_set ? block_size : CALGARY_BLOCK_SIZE;
+    bench.repeat = 10;
+    if (format != NULL && bench_report_start(format, output, &bench, argc, argv) != LZO_E_OK){
+        return 1;
+    }
+    plzo_exec *exec = bench_exec(&bench, bench.exec, thread_count);
+    if (exec == NULL){
+        return 1;
     }
-    fprintf(results_file, "%-15s%15d\n", "thread-count:", (int) thread_count);
-    printf("done\n");
+    bench_calgary(exec, bench.block_size);
+    plzo_exec_destroy(exec);
+    bench_report_finish();
     return 0;
 }
@@ -0,0 +1,469 @@
+/* plzo.h -- parallel LZO block engine
+
+   A pool of worker threads that compress or decompress blocks with
+   lzo1x. Work is handed over as an array of blocks; one submission is a
+   job, and the ticket returned by plzo_submit() completes when every
+   block of the job has been processed. Completion can be observed by
+   polling (plzo_test), blocking (plzo_wait), a callback run on the
+   worker that finished the job, or the pool's eventfd.
+ */
+
+#ifndef PLZO_H
+#define PLZO_H
+
+#include <lzo/lzoconf.h>
+#include <stdio.h>
+#ifdef PLZO_PROBES
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//direction of a job
+#define PLZO_COMPRESS   0
+#define PLZO_DECOMPRESS 1
+//or'ed into the direction: compression stores the adler32 of each raw block in its checksum,
+//decompression fails blocks whose output does not match it
+#define PLZO_CHECKSUM   2
+//instead of a direction: zeroes data and out of every block, so fresh buffers are first touched, and
+//their pages placed, on the NUMA node of the worker that will process each block
+#define PLZO_TOUCH      4
+//or'ed into the op: the caller took the buffers of the job from the memory budget itself, so the
+//submit does not charge them again
+#define PLZO_RESERVED   8
+
+//worst case size of a compressed block
+#define PLZO_COMPRESS_BOUND(n) ((n) + (n) / 16 + 64 + 3)
+//largest block size: block tables and frame headers store raw and compressed lengths in 32 bits, and
+//the bound of this size still fits
+#define PLZO_MAX_BLOCK_SIZE 0xF0000000ULL
+
+//one unit of work, out_size is the capacity of out on submit and the produced length on completion
+struct plzo_block_s {
+    lzo_bytep data;
+    lzo_bytep out;
+    lzo_uint data_size;
+    lzo_uint out_size;
+    lzo_uint32_t checksum;
+    int status;
+};
+
+typedef struct plzo_pool_s plzo_pool;
+typedef struct plzo_job_s plzo_job;
+//called once per job on the worker thread that processed its last block, after the job is marked done
+typedef void (*plzo_callback)(plzo_job *job, void *user);
+
+//where the workers of a pool run, all zero is what plzo_pool_create does, the lists are copied
+struct plzo_pool_options_s {
+    int numa; // spread the workers over the NUMA nodes, bound to their cpus, and cut every job into node ranges
+    const char *cpus; // cpu list such as 4-15,32-47, each worker is pinned to one of its cpus in turn
+    const char *avoid; // cpus the workers never run on, such as those kept for reading and writing
+};
+
+plzo_pool *plzo_pool_create(int thread_count);
+//options NULL is plzo_pool_create
+plzo_pool *plzo_pool_create_with(int thread_count, const struct plzo_pool_options_s *options);
+void plzo_pool_destroy(plzo_pool *pool);
+int plzo_pool_threads(const plzo_pool *pool);
+//block ranges every job is cut into, one per NUMA node with workers, 1 without options->numa
+int plzo_pool_nodes(const plzo_pool *pool);
+//kernel thread id of worker index, for tools that attach to one worker such as perf counters
+int plzo_pool_worker_tid(const plzo_pool *pool, int index);
+//time each worker spent on blocks, idle time is the elapsed time of a job minus busy
+struct plzo_worker_stats_s {
+    double busy; // wall seconds from taking a range of blocks until they are processed
+    double cpu; // thread cpu seconds over the same spans
+    unsigned long long blocks;
+    unsigned long ranges; // dequeues, blocks are handed out a grain at a time
+};
+//copies the counts of worker index, only call while the pool has no job in flight
+void plzo_pool_stats(const plzo_pool *pool, int index, struct plzo_worker_stats_s *stats);
+void plzo_pool_stats_reset(plzo_pool *pool);
+//largest busy time of a worker over the mean of all workers, 1 when perfectly balanced, 0 when idle
+double plzo_pool_imbalance(const plzo_pool *pool);
+//eventfd counting completed jobs, readable whenever a job finished since the last read
+int plzo_pool_eventfd(const plzo_pool *pool);
+
+//queues the blocks and returns immediately, the blocks must stay valid until the job completes; under
+//a memory budget it first waits for plzo_job_bytes, a job larger than the limit completes right away
+//with LZO_E_OUT_OF_MEMORY in every block
+plzo_job *plzo_submit(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+                      plzo_callback callback, void *user);
+//data_size plus out_size of the blocks, what a submit takes from the memory budget, 0 without a limit
+//or with PLZO_RESERVED or PLZO_TOUCH in op
+unsigned long long plzo_job_bytes(int op, const struct plzo_block_s *blocks, int block_count);
+//1 if the job completed, 0 otherwise, never blocks
+int plzo_test(plzo_job *job);
+//blocks until the job completed and returns its status
+int plzo_wait(plzo_job *job);
+//LZO_E_OK or the first error reported by one of the blocks
+int plzo_job_status(const plzo_job *job);
+void *plzo_job_user(const plzo_job *job);
+//submission number of the job in its pool, starting at 1
+unsigned long plzo_job_id(const plzo_job *job);
+//frees a completed ticket, the job's own callback may release it, while a callback still runs the
+//job is freed once it returned
+void plzo_release(plzo_job *job);
+
+/* Batches: many independent buffers in a single submission. The caller
+   fills data and data_size of every block (and out_size, the expected raw
+   length, when decompressing); the outputs are laid out one after the
+   other in a single caller supplied arena, item c starting at
+   blocks[c].out. */
+
+//arena size needed for a batch
+lzo_uint plzo_batch_bound(int op, const struct plzo_block_s *blocks, int block_count);
+//points the outputs of the blocks into arena in item order, LZO_E_OUTPUT_OVERRUN if it is too small
+int plzo_batch_layout(int op, struct plzo_block_s *blocks, int block_count, lzo_bytep arena, lzo_uint arena_size);
+//NULL if arena_size is smaller than plzo_batch_bound
+plzo_job *plzo_batch_submit(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+                            lzo_bytep arena, lzo_uint arena_size, plzo_callback callback, void *user);
+//submits and waits, returns the job status
+int plzo_batch(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+               lzo_bytep arena, lzo_uint arena_size);
+//compresses or decompresses one block the way a pool worker does, wrkmem holds LZO1X_1_MEM_COMPRESS
+//bytes, job and index only name the block in traces
+int plzo_block_run(int op, struct plzo_block_s *block, lzo_voidp wrkmem, unsigned long job, long index);
+
+/* Executors: the same blocks run on the worker pool, on an OpenMP team or
+   one after the other on the calling thread, so the drivers and the
+   benchmarks share one code path and only the executor differs. Every
+   executor keeps the per thread statistics of the pool. The OpenMP
+   executor exists when plzo_exec.c is built with -fopenmp and hands out
+   the blocks with schedule(runtime). */
+
+#define PLZO_EXEC_POOL   0
+#define PLZO_EXEC_OPENMP 1
+#define PLZO_EXEC_SERIAL 2
+#define PLZO_EXEC_KINDS  3
+
+typedef struct plzo_exec_s plzo_exec;
+
+//kind of pool, openmp or serial, -1 for anything else
+int plzo_exec_kind(const char *name);
+//pool, openmp or serial, NULL for an unknown kind
+const char *plzo_exec_kind_name(int kind);
+//NULL with a message when the kind is not built in, serial always has one thread, options NULL for
+//the defaults, OpenMP threads are placed like pool workers, contiguous node groups match a static schedule
+plzo_exec *plzo_exec_create(int kind, int thread_count, const struct plzo_pool_options_s *options);
+void plzo_exec_destroy(plzo_exec *exec);
+const char *plzo_exec_name(const plzo_exec *exec);
+int plzo_exec_threads(const plzo_exec *exec);
+//kernel thread id of thread index, as plzo_pool_worker_tid
+int plzo_exec_worker_tid(const plzo_exec *exec, int index);
+//the pool of a pool executor, NULL for the others
+plzo_pool *plzo_exec_pool(const plzo_exec *exec);
+//processes every block and returns LZO_E_OK or the first error, like a job
+int plzo_exec_run(plzo_exec *exec, int op, struct plzo_block_s *blocks, int block_count);
+//sets the schedule of the blocks over an OpenMP team as OMP_SCHEDULE spells it (static, dynamic,4,
+//guided ...), LZO_E_ERROR for other executors or an unknown kind, until then OMP_SCHEDULE applies
+int plzo_exec_schedule(plzo_exec *exec, const char *schedule);
+//plzo_batch on any executor
+int plzo_exec_batch(plzo_exec *exec, int op, struct plzo_block_s *blocks, int block_count,
+                    lzo_bytep arena, lzo_uint arena_size);
+void plzo_exec_stats(const plzo_exec *exec, int index, struct plzo_worker_stats_s *stats);
+void plzo_exec_stats_reset(plzo_exec *exec);
+double plzo_exec_imbalance(const plzo_exec *exec);
+
+/* CPU placement: cpu lists use the kernel syntax (0-3,8,10-11) and are
+   always limited to the affinity mask the process had when one of these
+   functions was first called, so a pool never leaves the cpus taskset or
+   a cpuset gave it. NUMA nodes are read from /sys/devices/system/node,
+   keeping only nodes with cpus the process may run on, and numbered 0 to
+   plzo_numa_nodes() - 1 in node order. Without that information there is
+   a single node and binding to it does nothing. */
+
+//cpus of list the process may use, every one of them for NULL, -1 if list is malformed
+int plzo_cpu_count(const char *list);
+//cpus worth of time the cgroup cpu quota of the process allows, the smallest of its cgroup and their
+//parents in cpu.max (v2) or cpu.cfs_quota_us over cpu.cfs_period_us (v1), 0 when there is none
+double plzo_cpu_quota(void);
+//default worker count: the cpus of list the process may use (the whole affinity mask for NULL), at
+//most the quota rounded up, and at least 1
+int plzo_cpu_threads(const char *list);
+//binds the calling thread to the cpus of list, LZO_E_ERROR if none of them may be used
+int plzo_cpu_bind(const char *list);
+//binds the calling thread as worker index of node under options, index counts from the first worker of
+//the node, done by pool workers and OpenMP threads as they start, so the memory they touch first is
+//allocated on their node
+int plzo_cpu_place(const struct plzo_pool_options_s *options, int node, int index);
+
+int plzo_numa_nodes(void);
+//the kernel's number of node, as in /sys/devices/system/node/node<N>
+int plzo_numa_node_id(int node);
+
+/* Large buffers: work memory and block buffers of the pool, the executors,
+   the streams and the archives come from plzo_alloc. With huge pages on,
+   buffers of 64K and more are mapped in whole huge pages (Hugepagesize in
+   /proc/meminfo) to save TLB misses on multi-GB jobs: hugetlb takes them
+   from the reserved pool (vm.nr_hugepages) and falls back to thp when it
+   is empty, thp maps them huge page aligned with madvise(MADV_HUGEPAGE),
+   which the kernel honours when transparent_hugepage is madvise or always,
+   and falls back to malloc if the mapping fails. */
+
+#define PLZO_PAGES_SMALL   0 // malloc
+#define PLZO_PAGES_THP     1
+#define PLZO_PAGES_HUGETLB 2
+#define PLZO_PAGE_KINDS    3
+
+//PLZO_PAGES_* for small, thp and hugetlb, -1 for other names
+int plzo_page_kind(const char *name);
+const char *plzo_page_kind_name(int kind);
+//applies to buffers allocated afterwards, set it before creating pools or executors
+void plzo_set_pages(int mode);
+int plzo_pages(void);
+//never returns NULL, free with plzo_free only
+lzo_voidp plzo_alloc(lzo_uint size);
+void plzo_free(lzo_voidp p);
+//bytes currently allocated as kind, rounded up to whole pages for the huge kinds
+unsigned long long plzo_page_bytes(int kind);
+
+/* Buffer pool: block buffers are recycled instead of freed, so a program
+   that compresses one file after another allocates (and page faults) only
+   until it reaches its largest working set. Buffers are kept in power of
+   two size classes; each thread keeps a few of every class on its own
+   free list and passes the rest to shared lists, where any thread takes
+   them. Recycled buffers keep the page kind they were allocated with. */
+
+struct plzo_buffer_stats_s {
+    unsigned long long gets; // plzo_buffer_get calls within the size classes
+    unsigned long long allocs; // of those, the ones that found no free buffer
+    unsigned long long cached; // bytes on the shared free lists
+};
+
+//a buffer of at least size bytes with the contents of its last use, never NULL
+lzo_voidp plzo_buffer_get(lzo_uint size);
+//returns a buffer of plzo_buffer_get or plzo_alloc to the pool, NULL is ignored
+void plzo_buffer_put(lzo_voidp p);
+//frees the shared free lists and the free list of the calling thread
+void plzo_buffer_trim(void);
+void plzo_buffer_stats(struct plzo_buffer_stats_s *stats);
+//memory a plzo_buffer_get of size takes, its size class rounded up to whole huge pages when they are on
+unsigned long long plzo_buffer_bytes(lzo_uint size);
+
+/* Memory budget: with a limit set, every job is admitted only once its
+   buffers fit next to the jobs already admitted, from any thread, and
+   waits until then. plzo_submit, plzo_batch and plzo_exec_run charge the
+   data_size and out_size of the blocks; the engine (archive members and
+   windows, extraction, streams, and plzo_file_compress) takes the
+   plzo_buffer_bytes of its own buffers up front and submits with
+   PLZO_RESERVED. A job larger than the whole limit is rejected with
+   LZO_E_OUT_OF_MEMORY, callers split their input instead: archives and
+   .plzo files are compressed and extracted in windows sized from their
+   largest blocks, so memory stays within the limit for any input size.
+   Free buffers of the pool count against the limit and are given back to
+   make room. Work memory of the workers and block arrays are not
+   counted, lzo-pthread --max-memory sets the limit net of them. */
+
+//0 for no limit, the default, set it before starting jobs
+void plzo_set_memory_limit(unsigned long long bytes);
+unsigned long long plzo_memory_limit(void);
+//waits until bytes fit in the budget and takes them, LZO_E_OUT_OF_MEMORY without waiting if they
+//are more than the whole limit
+int plzo_memory_acquire(unsigned long long bytes);
+//takes bytes only if they fit now, 1 if they were taken
+int plzo_memory_try_acquire(unsigned long long bytes);
+void plzo_memory_release(unsigned long long bytes);
+//bytes taken by admitted jobs
+unsigned long long plzo_memory_used(void);
+
+/* Streaming engine: input is cut into blocks that are compressed on the
+   pool while the caller keeps feeding data, at most depth blocks are in
+   flight at any time. Compressed output is a sequence of frames, each an
+   8 byte header (raw length, compressed length, both little endian 32 bit)
+   followed by the lzo1x data; a decompression stream takes those frames
+   and returns the raw blocks. Output comes back in input order. */
+
+//block size used when 0 is passed to plzo_stream_open
+#define PLZO_STREAM_BLOCK_SIZE (1024 * 1024)
+#define PLZO_FRAME_HEADER_SIZE 8
+
+typedef struct plzo_stream_s plzo_stream;
+
+//depth 0 means two blocks per worker, for decompression block_size is the largest raw block accepted,
+//under a memory budget depth is lowered to half the budget and the open waits until the slots fit,
+//NULL if a single slot is larger than the whole limit
+plzo_stream *plzo_stream_open(plzo_pool *pool, int op, lzo_uint block_size, int depth);
+//consumes input and returns how much was taken, less than len once depth blocks wait to be read
+lzo_uint plzo_stream_write(plzo_stream *stream, const lzo_bytep data, lzo_uint len);
+//marks the end of input and submits the last partial block
+int plzo_stream_finish(plzo_stream *stream);
+//returns 1 with the next output frame, 0 if it is not ready and wait is 0 or nothing is in flight,
+//or an lzo error code (also once the frames before a corrupt header were read), the frame stays
+//valid until the next write or finish
+int plzo_stream_read(plzo_stream *stream, lzo_bytep *frame, lzo_uint *frame_size, int wait);
+//arms a one-shot notification for the next frame, returns 0 without arming if plzo_stream_read
+//would not block, otherwise notify is called later on a worker thread
+int plzo_stream_notify(plzo_stream *stream, void (*notify)(void *user), void *user);
+//waits for blocks still in flight and frees the stream
+void plzo_stream_close(plzo_stream *stream);
+
+/* Archives (.plza) hold many files. Compressed blocks of all members come
+   first, followed by the block table (offset, raw and compressed length,
+   adler32 per block), the central directory (name, size, block range and
+   adler32 of every member) and a fixed size footer locating both, so
+   listing reads only the footer and the directory and extracting a member
+   reads its table entries and its blocks. All integers are little endian.
+   A .plzo file is the same container holding a single member. Appending
+   writes new blocks after the old trailer and then a trailer holding only
+   their table entries, the records of new or grown members and the end of
+   the old trailer, which it extends; opening follows that chain back to
+   the last complete trailer. Once the trailers of appends add up to a
+   complete one, an append writes a complete trailer again, so an append
+   costs its new data plus a proportional share of index and opening reads
+   at most about twice the index. If an append is interrupted, opening the
+   file falls back to the old trailer and the members stored before remain
+   readable. */
+
+#define PLZO_ARCHIVE_MAGIC "PLZA"
+#define PLZO_ARCHIVE_VERSION 2
+#define PLZO_ARCHIVE_HEADER_SIZE 8
+#define PLZO_ARCHIVE_FOOTER_SIZE 48
+#define PLZO_ARCHIVE_INDEX_SIZE 20
+
+struct plzo_entry_s {
+    char *name;
+    unsigned long long size;
+    unsigned long first_block;
+    unsigned long block_count;
+    lzo_uint32_t checksum;
+};
+typedef struct plzo_archive_s plzo_archive;
+
+//compresses the named files into a new archive, block_size 0 picks PLZO_STREAM_BLOCK_SIZE
+int plzo_archive_create(plzo_pool *pool, const char *path, char **names, int count, lzo_uint block_size);
+//appends to path, creating it if it does not exist: with as_members every named file becomes a new
+//member, otherwise the contents of the files ("-" is stdin) are added to the end of the last member
+int plzo_archive_append(plzo_pool *pool, const char *path, char **names, int count, lzo_uint block_size,
+                        int as_members);
+//writes a complete single member file from blocks compressed with PLZO_COMPRESS | PLZO_CHECKSUM
+int plzo_file_write(FILE *file, const char *name, struct plzo_block_s *blocks, int count);
+//the same file written while it is compressed: begin writes the header, each block is added in file
+//order as soon as it is done, end writes the trailer and frees the writer, the caller keeps the file
+typedef struct plzo_file_writer_s plzo_file_writer;
+plzo_file_writer *plzo_file_begin(FILE *file, const char *name);
+//job and index only name the block in traces, after an error nothing more is written
+int plzo_file_block(plzo_file_writer *writer, struct plzo_block_s *block, unsigned long job, long index);
+int plzo_file_end(plzo_file_writer *writer);
+//the same file compressed from everything readable from in, a window of blocks at a time, reading the
+//next window while one is compressed, so memory stays within the budget for any input size, block_size
+//0 picks PLZO_STREAM_BLOCK_SIZE
+int plzo_file_compress(plzo_pool *pool, FILE *in, FILE *out, const char *name, lzo_uint block_size);
+//reads the footer and the central directory, NULL if path is not an archive
+plzo_archive *plzo_archive_open(const char *path);
+int plzo_archive_count(const plzo_archive *archive);
+const struct plzo_entry_s *plzo_archive_entry(const plzo_archive *archive, int index);
+//extracts the named members below the current directory, or every member when count is 0
+int plzo_archive_extract(plzo_pool *pool, plzo_archive *archive, char **names, int count);
+//reads the compressed blocks of a member, returns the buffer they point into and an array of blocks
+//ready for a PLZO_DECOMPRESS | PLZO_CHECKSUM batch, or NULL if corrupt, the caller returns the buffer
+//with plzo_buffer_put and frees the blocks
+lzo_bytep plzo_archive_load(plzo_archive *archive, int index, struct plzo_block_s **blocks);
+void plzo_archive_close(plzo_archive *archive);
+
+/* Tracing: between plzo_trace_start() and plzo_trace_stop() the pool, the
+   archive code and the drivers record spans (read, compress, decompress,
+   checksum, write, wait) of every block with the thread that ran them, and
+   stop writes them as a Chrome Trace Event file that chrome://tracing and
+   Perfetto open. When tracing is off a span costs one load and a branch. */
+
+extern volatile int plzo_trace_on;
+//fails if path cannot be created
+int plzo_trace_start(const char *path);
+//writes the trace, call once the pools are destroyed so no thread is still recording
+int plzo_trace_stop(void);
+//names the calling thread in the trace, index < 0 for none
+void plzo_trace_thread(const char *name, int index);
+unsigned long long plzo_trace_clock(void);
+//records a span from start until now, job and block identify the block, job 0 for work outside a job
+//such as reading input and block < 0 for whole files
+void plzo_trace_span(const char *name, unsigned long long start, unsigned long job, long block, unsigned long long bytes);
+//start of a span, 0 when not tracing
+static inline unsigned long long plzo_trace_begin(void){
+    return plzo_trace_on ? plzo_trace_clock() : 0;
+}
+static inline void plzo_trace_end(const char *name, unsigned long long start, unsigned long job, long block,
+                                  unsigned long long bytes){
+    if (start != 0){
+        plzo_trace_span(name, start, job, block, bytes);
+    }
+}
+
+/* Probes: built with -DPLZO_PROBES the workers timestamp the lifecycle of
+   every block with the time stamp counter and keep a log2 histogram per
+   worker of the time a range of blocks waited in the queue, the codec and
+   checksum time of each block and the hand off of finished blocks back to
+   the submitter. Without PLZO_PROBES none of this is compiled in. */
+
+#ifdef PLZO_PROBES
+#define PLZO_PROBE_QUEUE    0 // submit to dequeue, once per range of blocks a worker takes
+#define PLZO_PROBE_CODEC    1 // lzo1x of one block
+#define PLZO_PROBE_CHECKSUM 2 // adler32 of one block
+#define PLZO_PROBE_HANDOFF  3 // last block done to the job accounted for and its callback returned
+#define PLZO_PROBE_KINDS    4
+#define PLZO_PROBE_BUCKETS  64
+
+//bucket b counts spans of 2^b to 2^(b+1) - 1 ticks
+struct plzo_probes_s {
+    unsigned long long count[PLZO_PROBE_KINDS][PLZO_PROBE_BUCKETS];
+    unsigned long long ticks[PLZO_PROBE_KINDS];
+    unsigned long long events[PLZO_PROBE_KINDS];
+};
+
+//rdtsc inline rather than lzo_tsc_read from lzo_supp.h, which is a call storing through a pointer
+static inline unsigned long long plzo_tsc(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    unsigned long long t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r" (t));
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+static inline void plzo_probe_add(struct plzo_probes_s *probes, int kind, unsigned long long ticks){
+    probes->count[kind][63 - __builtin_clzll(ticks | 1)]++;
+    probes->ticks[kind] += ticks;
+    probes->events[kind]++;
+}
+#define PLZO_TSC(name) unsigned long long name = plzo_tsc()
+#define PLZO_PROBE(probes, kind, start) plzo_probe_add(probes, kind, plzo_tsc() - (start))
+
+//copies the histograms of worker index, only call while the pool has no job in flight
+void plzo_pool_probes(const plzo_pool *pool, int index, struct plzo_probes_s *probes);
+void plzo_pool_probes_reset(plzo_pool *pool);
+#else
+#define PLZO_TSC(name)
+#define PLZO_PROBE(probes, kind, start) ((void) 0)
+#endif
+
+//adler32 of two concatenated pieces given the adler32 of each and the length of the second
+lzo_uint32_t plzo_adler32_combine(lzo_uint32_t adler1, lzo_uint32_t adler2, unsigned long long len2);
+
+static inline void plzo_put_le32(lzo_bytep p, lzo_uint32_t v){
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+}
+static inline lzo_uint32_t plzo_get_le32(const unsigned char *p){
+    return (lzo_uint32_t) p[0] | (lzo_uint32_t) p[1] << 8 | (lzo_uint32_t) p[2] << 16 | (lzo_uint32_t) p[3] << 24;
+}
+static inline void plzo_put_le64(lzo_bytep p, unsigned long long v){
+    plzo_put_le32(p, (lzo_uint32_t) v);
+    plzo_put_le32(p + 4, (lzo_uint32_t) (v >> 32));
+}
+static inline unsigned long long plzo_get_le64(const unsigned char *p){
+    return (unsigned long long) plzo_get_le32(p) | (unsigned long long) plzo_get_le32(p + 4) << 32;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
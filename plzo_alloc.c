@@ -0,0 +1,359 @@
+#include <lzo/lzoconf.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+//in front of every buffer, a cache line so the data stays aligned
+#define HEADER_SIZE 64
+//smaller buffers are not worth a huge page of their own
+#define HUGE_MIN (64 * 1024)
+//size classes of the buffer pool, four per power of two: class 4 * e + s holds (4 + s) * 2^(e - 2)
+//bytes header included, so a window of a power of two blocks wastes a quarter instead of doubling,
+//and classes from 8M up fill whole huge pages
+#define MIN_CLASS (4 * 12)
+#define MAX_CLASS (4 * 47 + 3)
+#define CLASSES (MAX_CLASS + 1)
+//buffers a thread keeps of each class before it returns them to the shared lists
+#define THREAD_CACHE 4
+
+struct header_s {
+    size_t length; // of the mapping, or of the malloc block
+    int kind;
+    int size_class; // -1 outside the buffer pool
+    struct header_s *next; // while on a free list
+};
+
+//free buffers of a thread, the same thread takes them back without a lock
+struct cache_s {
+    struct header_s *head[CLASSES];
+    int count[CLASSES];
+};
+
+static const char *page_names[PLZO_PAGE_KINDS] = {"small", "thp", "hugetlb"};
+static int page_mode = PLZO_PAGES_SMALL;
+static size_t huge_size = 0;
+static unsigned long long page_bytes[PLZO_PAGE_KINDS];
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct header_s *shared[CLASSES];
+static struct plzo_buffer_stats_s buffer_stats; // the counters are atomic, cached is under shared_lock
+//memory budget, under shared_lock, jobs waiting for room sleep on budget_cond
+static unsigned long long memory_limit = 0;
+static unsigned long long memory_used = 0;
+static pthread_cond_t budget_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static __thread struct cache_s *thread_cache;
+
+//Hugepagesize from /proc/meminfo, 2M when it cannot be read
+static size_t huge_page_size(void){
+    char line[128];
+    unsigned long kb = 0;
+    FILE *file = fopen("/proc/meminfo", "r");
+    while (file != NULL && fgets(line, sizeof line, file) != NULL){
+        if (strncmp(line, "Hugepagesize:", 13) == 0){
+            kb = strtoul(line + 13, NULL, 10);
+            break;
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+    return kb > 0 ? kb * 1024 : 2 * 1024 * 1024;
+}
+int plzo_page_kind(const char *name){
+    int c;
+    for (c = 0; c < PLZO_PAGE_KINDS; c++){
+        if (strcmp(name, page_names[c]) == 0){
+            return c;
+        }
+    }
+    return -1;
+}
+const char *plzo_page_kind_name(int kind){
+    return kind >= 0 && kind < PLZO_PAGE_KINDS ? page_names[kind] : NULL;
+}
+void plzo_set_pages(int mode){
+    if (huge_size == 0){
+        huge_size = huge_page_size();
+    }
+    page_mode = mode;
+}
+int plzo_pages(void){
+    return page_mode;
+}
+//a mapping aligned to the huge page size with the kernel asked to back it with transparent huge
+//pages, NULL if the mapping fails, whether THP is used depends on /sys/kernel/mm/transparent_hugepage
+static void *map_thp(size_t length){
+    char *p = (char *) mmap(NULL, length + huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED){
+        return NULL;
+    }
+    char *aligned = (char *) (((uintptr_t) p + huge_size - 1) & ~(uintptr_t) (huge_size - 1));
+    if (aligned > p){
+        munmap(p, aligned - p);
+    }
+    munmap(aligned + length, p + huge_size - aligned);
+    madvise(aligned, length, MADV_HUGEPAGE);
+    return aligned;
+}
+lzo_voidp plzo_alloc(lzo_uint size){
+    struct header_s *h = NULL;
+    int kind = PLZO_PAGES_SMALL;
+    size_t length = size + HEADER_SIZE;
+    if (page_mode != PLZO_PAGES_SMALL && size >= HUGE_MIN){
+        size_t huge_length = (length + huge_size - 1) & ~(huge_size - 1);
+        if (page_mode == PLZO_PAGES_HUGETLB){ // from the reserved pool, vm.nr_hugepages
+            h = (struct header_s *) mmap(NULL, huge_length, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            kind = PLZO_PAGES_HUGETLB;
+            if (h == MAP_FAILED){ // the pool is empty or not configured
+                h = NULL;
+            }
+        }
+        if (h == NULL){
+            h = (struct header_s *) map_thp(huge_length);
+            kind = PLZO_PAGES_THP;
+        }
+        if (h != NULL){
+            length = huge_length;
+        }
+    }
+    if (h == NULL){
+        h = (struct header_s *) xmalloc(length);
+        kind = PLZO_PAGES_SMALL;
+    }
+    h->length = length;
+    h->kind = kind;
+    h->size_class = -1;
+    __atomic_add_fetch(&page_bytes[kind], length, __ATOMIC_RELAXED);
+    return (lzo_voidp) ((char *) h + HEADER_SIZE);
+}
+void plzo_free(lzo_voidp p){
+    if (p == NULL){
+        return;
+    }
+    struct header_s *h = (struct header_s *) ((char *) p - HEADER_SIZE);
+    __atomic_sub_fetch(&page_bytes[h->kind], h->length, __ATOMIC_RELAXED);
+    if (h->kind == PLZO_PAGES_SMALL){
+        free(h);
+    } else {
+        munmap(h, h->length);
+    }
+}
+unsigned long long plzo_page_bytes(int kind){
+    return __atomic_load_n(&page_bytes[kind], __ATOMIC_RELAXED);
+}
+static size_t class_size(int c){
+    return (size_t) (4 + (c & 3)) << ((c >> 2) - 2);
+}
+//smallest class whose buffers hold size bytes after the header, -1 when it is beyond the largest class
+static int size_class(lzo_uint size){
+    int c = MIN_CLASS;
+    while (c <= MAX_CLASS && class_size(c) - HEADER_SIZE < size){
+        c++;
+    }
+    return c <= MAX_CLASS ? c : -1;
+}
+//frees shared buffers until they fit next to the admitted jobs, called with shared_lock held
+static void shrink(void){
+    int c;
+    for (c = MAX_CLASS; c >= MIN_CLASS && memory_used + buffer_stats.cached > memory_limit; c--){
+        while (shared[c] != NULL && memory_used + buffer_stats.cached > memory_limit){
+            struct header_s *h = shared[c];
+            shared[c] = h->next;
+            buffer_stats.cached -= h->length;
+            plzo_free((char *) h + HEADER_SIZE);
+        }
+    }
+}
+//puts h on the shared list of its class, or frees it when caching it would go over the budget
+static void share(struct header_s *h){
+    pthread_mutex_lock(&shared_lock);
+    if (memory_limit != 0 && memory_used + buffer_stats.cached + h->length > memory_limit){
+        pthread_mutex_unlock(&shared_lock);
+        plzo_free((char *) h + HEADER_SIZE);
+        return;
+    }
+    h->next = shared[h->size_class];
+    shared[h->size_class] = h;
+    buffer_stats.cached += h->length;
+    pthread_mutex_unlock(&shared_lock);
+}
+//buffers of a thread that exits go to the shared lists
+static void cache_exit(void *arg){
+    struct cache_s *cache = (struct cache_s *) arg;
+    int c;
+    for (c = 0; c < CLASSES; c++){
+        while (cache->head[c] != NULL){
+            struct header_s *h = cache->head[c];
+            cache->head[c] = h->next;
+            share(h);
+        }
+    }
+    free(cache);
+}
+static void cache_init(void){
+    pthread_key_create(&cache_key, cache_exit);
+}
+static struct cache_s *get_cache(void){
+    if (thread_cache == NULL){
+        pthread_once(&cache_once, cache_init);
+        thread_cache = (struct cache_s *) xmalloc(sizeof(struct cache_s));
+        memset(thread_cache, 0, sizeof(struct cache_s));
+        pthread_setspecific(cache_key, thread_cache);
+    }
+    return thread_cache;
+}
+lzo_voidp plzo_buffer_get(lzo_uint size){
+    int c = size_class(size);
+    struct header_s *h = NULL;
+    if (c < 0){
+        return plzo_alloc(size);
+    }
+    struct cache_s *cache = get_cache();
+    __atomic_add_fetch(&buffer_stats.gets, 1, __ATOMIC_RELAXED);
+    if (cache->head[c] != NULL){
+        h = cache->head[c];
+        cache->head[c] = h->next;
+        cache->count[c]--;
+    } else {
+        pthread_mutex_lock(&shared_lock);
+        h = shared[c];
+        if (h != NULL){
+            shared[c] = h->next;
+            buffer_stats.cached -= h->length;
+        }
+        pthread_mutex_unlock(&shared_lock);
+    }
+    if (h == NULL){
+        __atomic_add_fetch(&buffer_stats.allocs, 1, __ATOMIC_RELAXED);
+        h = (struct header_s *) ((char *) plzo_alloc(class_size(c) - HEADER_SIZE) - HEADER_SIZE);
+        h->size_class = c;
+    }
+    return (lzo_voidp) ((char *) h + HEADER_SIZE);
+}
+void plzo_buffer_put(lzo_voidp p){
+    if (p == NULL){
+        return;
+    }
+    struct header_s *h = (struct header_s *) ((char *) p - HEADER_SIZE);
+    if (h->size_class < 0){
+        plzo_free(p);
+        return;
+    }
+    struct cache_s *cache = get_cache();
+    //under a budget every free buffer is on the shared lists, where shrink can give it back
+    if (cache->count[h->size_class] < THREAD_CACHE && __atomic_load_n(&memory_limit, __ATOMIC_RELAXED) == 0){
+        h->next = cache->head[h->size_class];
+        cache->head[h->size_class] = h;
+        cache->count[h->size_class]++;
+    } else {
+        share(h);
+    }
+}
+void plzo_buffer_trim(void){
+    struct header_s *list[CLASSES];
+    int c;
+    if (thread_cache != NULL){ // the calling thread's own cache goes with the shared lists
+        cache_exit(thread_cache);
+        thread_cache = NULL;
+        pthread_setspecific(cache_key, NULL);
+    }
+    pthread_mutex_lock(&shared_lock);
+    memcpy(list, shared, sizeof list);
+    memset(shared, 0, sizeof shared);
+    buffer_stats.cached = 0;
+    pthread_mutex_unlock(&shared_lock);
+    for (c = 0; c < CLASSES; c++){
+        while (list[c] != NULL){
+            struct header_s *h = list[c];
+            list[c] = h->next;
+            plzo_free((char *) h + HEADER_SIZE);
+        }
+    }
+}
+void plzo_buffer_stats(struct plzo_buffer_stats_s *stats){
+    stats->gets = __atomic_load_n(&buffer_stats.gets, __ATOMIC_RELAXED);
+    stats->allocs = __atomic_load_n(&buffer_stats.allocs, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&shared_lock);
+    stats->cached = buffer_stats.cached;
+    pthread_mutex_unlock(&shared_lock);
+}
+unsigned long long plzo_buffer_bytes(lzo_uint size){
+    int c = size_class(size);
+    unsigned long long length = c >= 0 ? class_size(c) : size + HEADER_SIZE;
+    if (page_mode != PLZO_PAGES_SMALL && size >= HUGE_MIN){ // assumes the huge mapping succeeds
+        length = (length + huge_size - 1) & ~(unsigned long long) (huge_size - 1);
+    }
+    return length;
+}
+void plzo_set_memory_limit(unsigned long long bytes){
+    pthread_mutex_lock(&shared_lock);
+    memory_limit = bytes;
+    if (memory_limit != 0){
+        shrink();
+    }
+    pthread_cond_broadcast(&budget_cond);
+    pthread_mutex_unlock(&shared_lock);
+    plzo_buffer_trim(); // the thread caches are no longer used under a budget
+}
+unsigned long long plzo_memory_limit(void){
+    return __atomic_load_n(&memory_limit, __ATOMIC_RELAXED);
+}
+//true if bytes fit next to the admitted jobs
+static int fits(unsigned long long bytes){
+    return memory_limit == 0 || memory_used + bytes <= memory_limit;
+}
+static void admit(unsigned long long bytes){
+    memory_used += bytes;
+    if (memory_limit != 0){
+        shrink();
+    }
+}
+int plzo_memory_acquire(unsigned long long bytes){
+    pthread_mutex_lock(&shared_lock);
+    while (!fits(bytes)){
+        if (bytes > memory_limit){ // would wait forever, also if the limit was lowered meanwhile
+            pthread_mutex_unlock(&shared_lock);
+            return LZO_E_OUT_OF_MEMORY;
+        }
+        pthread_cond_wait(&budget_cond, &shared_lock);
+    }
+    admit(bytes);
+    pthread_mutex_unlock(&shared_lock);
+    return LZO_E_OK;
+}
+int plzo_memory_try_acquire(unsigned long long bytes){
+    int ok;
+    pthread_mutex_lock(&shared_lock);
+    ok = fits(bytes);
+    if (ok){
+        admit(bytes);
+    }
+    pthread_mutex_unlock(&shared_lock);
+    return ok;
+}
+void plzo_memory_release(unsigned long long bytes){
+    pthread_mutex_lock(&shared_lock);
+    memory_used -= bytes;
+    pthread_cond_broadcast(&budget_cond);
+    pthread_mutex_unlock(&shared_lock);
+}
+unsigned long long plzo_memory_used(void){
+    unsigned long long used;
+    pthread_mutex_lock(&shared_lock);
+    used = memory_used;
+    pthread_mutex_unlock(&shared_lock);
+    return used;
+}
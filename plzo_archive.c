@@ -0,0 +1,1185 @@
+#include <lzo/lzoconf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+//the block table entries one trailer holds, those of the blocks written since the trailer before it
+struct segment_s {
+    unsigned long long table_offset; // the blocks themselves all lie before it
+    unsigned long first_block;
+    unsigned long block_count;
+};
+struct plzo_archive_s {
+    FILE *file;
+    unsigned long long end; // just past the last footer, appends go here
+    unsigned long block_count;
+    int entry_count;
+    struct plzo_entry_s *entries;
+    struct segment_s *segments; // oldest first, together they make the block table
+    int segment_count;
+    unsigned long long delta_bytes; // trailers written by appends since the last complete one
+};
+//one member being compressed or extracted
+struct member_s {
+    struct plzo_entry_s *entry;
+    const char *path;
+    unsigned long long size;
+    lzo_bytep data;
+    lzo_bytep out;
+    struct plzo_block_s *blocks;
+    unsigned long count;
+    plzo_job *job;
+    unsigned long long held; // taken from the memory budget
+};
+//block table and directory of an archive being written, blocks go at offset and the trailer after them;
+//the trailer holds the table entries from first_block on and the records of the members from first_entry
+//on, the rest is in the trailers before it, found from prev
+struct writer_s {
+    FILE *file;
+    unsigned long long offset;
+    unsigned long long prev; // end of the trailer this one extends, 0 for a complete trailer
+    lzo_bytep table; // entries of the blocks from first_block on
+    unsigned long first_block;
+    unsigned long block_count;
+    unsigned long table_size;
+    struct plzo_entry_s *entries;
+    int first_entry; // members from here on are new or have grown
+    int entry_count;
+    int entry_size;
+};
+//a window of input appended to the last member
+struct window_s {
+    lzo_bytep data;
+    lzo_bytep out;
+    struct plzo_block_s *blocks;
+    int count;
+    plzo_job *job;
+};
+
+//members kept in memory at once, both while creating and while extracting
+static int max_members(plzo_pool *pool){
+    return 4 * plzo_pool_threads(pool);
+}
+static unsigned long long max_bytes(plzo_pool *pool, lzo_uint block_size){
+    return 64ULL * block_size * plzo_pool_threads(pool);
+}
+//budget of a member of size raw bytes held whole in memory with the bound of its compressed blocks
+static unsigned long long member_bytes(unsigned long long size, lzo_uint block_size){
+    unsigned long long count = (size + block_size - 1) / block_size;
+    return plzo_buffer_bytes(size + 1) + plzo_buffer_bytes(size + size / 16 + 67 * (count ? count : 1) + 1);
+}
+//true if a member needs more than half the budget, it then goes through windows instead, so another
+//job always finds room next to it
+static bool too_large(unsigned long long bytes){
+    return plzo_memory_limit() != 0 && bytes > plzo_memory_limit() / 2;
+}
+//member names are stored relative, without leading slashes or ./
+static const char *member_name(const char *path){
+    for (;;){
+        if (path[0] == '/'){
+            path++;
+        } else if (path[0] == '.' && path[1] == '/'){
+            path += 2;
+        } else {
+            return path;
+        }
+    }
+}
+static void free_member(struct member_s *m){
+    plzo_buffer_put(m->data);
+    plzo_buffer_put(m->out);
+    free(m->blocks);
+    m->data = NULL;
+    m->out = NULL;
+    m->blocks = NULL;
+    m->job = NULL;
+    plzo_memory_release(m->held);
+    m->held = 0;
+}
+//writes one compressed block at the end of the data and records it in the table and in the entry it
+//belongs to, job and index only name the block in traces
+static int write_block(struct writer_s *w, struct plzo_entry_s *entry, struct plzo_block_s *block,
+                       unsigned long job, long index){
+    unsigned long long trace = plzo_trace_begin();
+    if (fwrite(block->out, 1, block->out_size, w->file) != block->out_size){
+        return LZO_E_ERROR;
+    }
+    plzo_trace_end("write", trace, job, index, block->out_size);
+    unsigned long used = w->block_count - w->first_block;
+    if (used == w->table_size){
+        w->table_size = w->table_size ? w->table_size * 2 : 1024;
+        lzo_bytep table = (lzo_bytep) xmalloc(w->table_size * PLZO_ARCHIVE_INDEX_SIZE);
+        if (used > 0){
+            memcpy(table, w->table, used * PLZO_ARCHIVE_INDEX_SIZE);
+        }
+        free(w->table);
+        w->table = table;
+    }
+    lzo_bytep p = w->table + used * PLZO_ARCHIVE_INDEX_SIZE;
+    plzo_put_le64(p, w->offset);
+    plzo_put_le32(p + 8, block->data_size);
+    plzo_put_le32(p + 12, block->out_size);
+    plzo_put_le32(p + 16, block->checksum);
+    if (entry->block_count == 0){
+        entry->first_block = w->block_count;
+    }
+    if (entry - w->entries < w->first_entry){ // a stored member grew, its record goes in the new trailer
+        w->first_entry = (int) (entry - w->entries);
+    }
+    w->block_count++;
+    w->offset += block->out_size;
+    entry->block_count++;
+    entry->size += block->data_size;
+    entry->checksum = plzo_adler32_combine(entry->checksum, block->checksum, block->data_size);
+    return LZO_E_OK;
+}
+//adds an empty entry and returns it, the writer owns a copy of the name
+static struct plzo_entry_s *add_entry(struct writer_s *w, const char *name){
+    if (w->entry_count == w->entry_size){
+        w->entry_size = w->entry_size ? w->entry_size * 2 : 64;
+        struct plzo_entry_s *entries = (struct plzo_entry_s *) xmalloc(sizeof(struct plzo_entry_s) * w->entry_size);
+        if (w->entry_count > 0){
+            memcpy(entries, w->entries, sizeof(struct plzo_entry_s) * w->entry_count);
+        }
+        free(w->entries);
+        w->entries = entries;
+    }
+    struct plzo_entry_s *e = &w->entries[w->entry_count++];
+    e->name = strdup(member_name(name));
+    e->size = 0;
+    e->first_block = 0;
+    e->block_count = 0;
+    e->checksum = lzo_adler32(0, NULL, 0);
+    return e;
+}
+static bool writer_create(struct writer_s *w, const char *path){
+    unsigned char header[PLZO_ARCHIVE_HEADER_SIZE];
+    memset(w, 0, sizeof(struct writer_s));
+    w->file = fopen(path, "wb");
+    if (w->file == NULL){
+        printf("cannot create %s\n", path);
+        return false;
+    }
+    memcpy(header, PLZO_ARCHIVE_MAGIC, 4);
+    plzo_put_le32(header + 4, PLZO_ARCHIVE_VERSION);
+    if (fwrite(header, 1, PLZO_ARCHIVE_HEADER_SIZE, w->file) != PLZO_ARCHIVE_HEADER_SIZE){
+        printf("cannot write %s\n", path);
+        fclose(w->file);
+        return false;
+    }
+    w->offset = PLZO_ARCHIVE_HEADER_SIZE;
+    return true;
+}
+//bytes of a complete trailer for these members and blocks
+static unsigned long long index_bytes(const struct plzo_entry_s *entries, int entry_count, unsigned long block_count){
+    unsigned long long bytes = (unsigned long long) block_count * PLZO_ARCHIVE_INDEX_SIZE + PLZO_ARCHIVE_FOOTER_SIZE;
+    int c;
+    for (c = 0; c < entry_count; c++){
+        bytes += 2 + strlen(entries[c].name) + 20;
+    }
+    return bytes;
+}
+static bool read_index(plzo_archive *archive, unsigned long first, unsigned long count, lzo_bytep table);
+//picks up an existing archive, new blocks and the trailer written on finish go after its trailer, which
+//stays valid until the new one is complete. The new trailer only holds the new blocks and the new or
+//grown members and points back at the old one, unless the trailers of appends since the last complete
+//one add up to a complete one: then it is complete again, so opening reads at most about twice the
+//index and every append costs the new data plus a share of the index proportional to it
+static bool writer_reopen(struct writer_s *w, const char *path){
+    int c;
+    memset(w, 0, sizeof(struct writer_s));
+    plzo_archive *archive = plzo_archive_open(path);
+    if (archive == NULL){
+        printf("%s is not a plzo file\n", path);
+        return false;
+    }
+    w->block_count = archive->block_count;
+    w->first_block = archive->block_count;
+    w->first_entry = archive->entry_count;
+    w->prev = archive->end;
+    if (archive->delta_bytes >= index_bytes(archive->entries, archive->entry_count, archive->block_count)){
+        w->first_block = 0;
+        w->first_entry = 0;
+        w->prev = 0;
+        w->table_size = archive->block_count;
+        w->table = (lzo_bytep) xmalloc(w->table_size * PLZO_ARCHIVE_INDEX_SIZE + 1);
+        if (!read_index(archive, 0, archive->block_count, w->table)){
+            printf("%s is corrupt\n", path);
+            free(w->table);
+            plzo_archive_close(archive);
+            return false;
+        }
+    }
+    w->offset = archive->end; // past a tail left by an interrupted append, if any
+    w->entries = archive->entries;
+    w->entry_count = archive->entry_count;
+    w->entry_size = archive->entry_count;
+    archive->entries = NULL;
+    plzo_archive_close(archive);
+    w->file = fopen(path, "r+b");
+    if (w->file == NULL || fseeko(w->file, w->offset, SEEK_SET) != 0){
+        printf("cannot open %s for writing\n", path);
+        if (w->file != NULL){
+            fclose(w->file);
+        }
+        for (c = 0; c < w->entry_count; c++){
+            free(w->entries[c].name);
+        }
+        free(w->entries);
+        free(w->table);
+        return false;
+    }
+    return true;
+}
+//block table entries and directory records the writer holds and the footer, frees the writer's table
+//and entries; the footer is only written once the rest is, so a short write never leaves a footer over
+//a cut index
+static int write_trailer(struct writer_s *w){
+    unsigned char footer[PLZO_ARCHIVE_FOOTER_SIZE];
+    int c;
+    unsigned long long table_offset = w->offset;
+    unsigned long count = w->block_count - w->first_block;
+    bool ok = fwrite(w->table, PLZO_ARCHIVE_INDEX_SIZE, count, w->file) == count;
+    unsigned long long dir_offset = table_offset + (unsigned long long) count * PLZO_ARCHIVE_INDEX_SIZE;
+    for (c = w->first_entry; c < w->entry_count; c++){
+        unsigned char record[20];
+        size_t len = strlen(w->entries[c].name);
+        record[0] = (unsigned char) len;
+        record[1] = (unsigned char) (len >> 8);
+        ok = ok && fwrite(record, 1, 2, w->file) == 2 && fwrite(w->entries[c].name, 1, len, w->file) == len;
+        plzo_put_le64(record, w->entries[c].size);
+        plzo_put_le32(record + 8, w->entries[c].first_block);
+        plzo_put_le32(record + 12, w->entries[c].block_count);
+        plzo_put_le32(record + 16, w->entries[c].checksum);
+        ok = ok && fwrite(record, 1, 20, w->file) == 20;
+    }
+    for (c = 0; c < w->entry_count; c++){
+        free(w->entries[c].name);
+    }
+    plzo_put_le64(footer, table_offset);
+    plzo_put_le64(footer + 8, dir_offset);
+    plzo_put_le64(footer + 16, w->prev);
+    plzo_put_le32(footer + 24, w->block_count);
+    plzo_put_le32(footer + 28, w->entry_count);
+    plzo_put_le32(footer + 32, w->first_block);
+    plzo_put_le32(footer + 36, w->first_entry);
+    plzo_put_le32(footer + 40, PLZO_ARCHIVE_VERSION);
+    memcpy(footer + 44, PLZO_ARCHIVE_MAGIC, 4);
+    free(w->table);
+    free(w->entries);
+    //flushed first, a buffered write error would otherwise only show once the footer is out too
+    if (!ok || fflush(w->file) != 0 || fwrite(footer, 1, PLZO_ARCHIVE_FOOTER_SIZE, w->file) != PLZO_ARCHIVE_FOOTER_SIZE){
+        return LZO_E_ERROR;
+    }
+    return LZO_E_OK;
+}
+static int writer_finish(struct writer_s *w){
+    int status = write_trailer(w);
+    //cuts off what is left of a longer append that was interrupted
+    if (fflush(w->file) != 0 || ftruncate(fileno(w->file), ftello(w->file)) != 0){
+        status = LZO_E_ERROR;
+    }
+    if (fclose(w->file) != 0){
+        status = LZO_E_ERROR;
+    }
+    return status;
+}
+//reads a whole file, up to the size it was admitted with, and submits its blocks
+static bool start_compress(plzo_pool *pool, struct member_s *m, lzo_uint block_size){
+    unsigned long c;
+    FILE *infile = fopen(m->path, "rb");
+    if (infile == NULL){
+        printf("cannot open %s\n", m->path);
+        return false;
+    }
+    unsigned long long in_len = m->size; // as admitted, a file that grew since is cut there
+    m->data = (lzo_bytep) plzo_buffer_get(in_len + 1);
+    unsigned long long trace = plzo_trace_begin();
+    in_len = fread(m->data, 1, in_len, infile);
+    plzo_trace_end("read", trace, 0, -1, in_len);
+    fclose(infile);
+    m->count = (in_len + block_size - 1) / block_size;
+    m->blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * (m->count ? m->count : 1));
+    for (c = 0; c < m->count; c++){
+        m->blocks[c].data = m->data + c * block_size;
+        m->blocks[c].data_size = c == m->count - 1 ? in_len - c * block_size : block_size;
+    }
+    lzo_uint out_len = plzo_batch_bound(PLZO_COMPRESS, m->blocks, m->count);
+    m->out = (lzo_bytep) plzo_buffer_get(out_len);
+    m->job = plzo_batch_submit(pool, PLZO_COMPRESS | PLZO_CHECKSUM | PLZO_RESERVED, m->blocks, m->count, m->out, out_len,
+                               NULL, NULL);
+    return true;
+}
+//appends the compressed blocks of a finished member to the archive
+static int finish_compress(struct member_s *m, struct writer_s *w){
+    unsigned long c;
+    unsigned long job = plzo_job_id(m->job);
+    int r = plzo_wait(m->job);
+    plzo_release(m->job);
+    if (r != LZO_E_OK){
+        printf("parallel comp error %d - %s\n", r, m->path);
+        free_member(m);
+        return r;
+    }
+    struct plzo_entry_s *e = add_entry(w, m->path);
+    for (c = 0; c < m->count && r == LZO_E_OK; c++){
+        r = write_block(w, e, &m->blocks[c], job, c);
+    }
+    if (r != LZO_E_OK){
+        printf("write error - %s\n", m->path);
+    }
+    free_member(m);
+    return r;
+}
+//reads up to one window of input and submits it
+static void start_window(plzo_pool *pool, struct window_s *win, FILE *in, lzo_uint block_size, int max_blocks){
+    int c;
+    unsigned long long trace = plzo_trace_begin();
+    lzo_uint len = fread(win->data, 1, block_size * max_blocks, in);
+    plzo_trace_end("read", trace, 0, -1, len);
+    win->count = (len + block_size - 1) / block_size;
+    for (c = 0; c < win->count; c++){
+        win->blocks[c].data = win->data + c * block_size;
+        win->blocks[c].data_size = c == win->count - 1 ? len - c * block_size : block_size;
+    }
+    win->job = NULL;
+    if (win->count > 0){
+        lzo_uint out_len = plzo_batch_bound(PLZO_COMPRESS, win->blocks, win->count);
+        win->job = plzo_batch_submit(pool, PLZO_COMPRESS | PLZO_CHECKSUM | PLZO_RESERVED, win->blocks, win->count,
+                                     win->out, out_len, NULL, NULL);
+    }
+}
+//budget of the two windows of extend_last
+static unsigned long long window_bytes(lzo_uint block_size, int blocks){
+    return 2 * (plzo_buffer_bytes(block_size * blocks) + plzo_buffer_bytes(PLZO_COMPRESS_BOUND(block_size) * blocks));
+}
+//compresses everything readable from in into new blocks of the last member, reading the next
+//window while the current one is compressed so memory stays bounded for any input size
+static int extend_last(plzo_pool *pool, struct writer_s *w, FILE *in, lzo_uint block_size){
+    struct window_s win[2];
+    int max_blocks = max_members(pool);
+    while (max_blocks > 1 && too_large(window_bytes(block_size, max_blocks))){ // fewer blocks per window under a budget
+        max_blocks--;
+    }
+    unsigned long long need = window_bytes(block_size, max_blocks);
+    int status = LZO_E_OK;
+    int cur = 0;
+    int c, i;
+    struct plzo_entry_s *e = &w->entries[w->entry_count - 1];
+    if (e->block_count > 0 && e->first_block + e->block_count != w->block_count){
+        printf("the last member does not end the block table\n");
+        return LZO_E_ERROR;
+    }
+    if (plzo_memory_acquire(need) != LZO_E_OK){
+        printf("blocks of %luK do not fit the memory budget\n", (unsigned long) (block_size / 1024));
+        return LZO_E_OUT_OF_MEMORY;
+    }
+    for (i = 0; i < 2; i++){
+        win[i].data = (lzo_bytep) plzo_buffer_get(block_size * max_blocks);
+        win[i].out = (lzo_bytep) plzo_buffer_get(PLZO_COMPRESS_BOUND(block_size) * max_blocks);
+        win[i].blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * max_blocks);
+    }
+    start_window(pool, &win[cur], in, block_size, max_blocks);
+    while (win[cur].count > 0){
+        start_window(pool, &win[1 - cur], in, block_size, max_blocks);
+        unsigned long job = plzo_job_id(win[cur].job);
+        int r = plzo_wait(win[cur].job);
+        plzo_release(win[cur].job);
+        for (c = 0; c < win[cur].count && r == LZO_E_OK; c++){
+            r = write_block(w, e, &win[cur].blocks[c], job, c);
+        }
+        if (r != LZO_E_OK){
+            status = r;
+            cur = 1 - cur;
+            if (win[cur].job != NULL){
+                plzo_wait(win[cur].job);
+                plzo_release(win[cur].job);
+            }
+            break;
+        }
+        cur = 1 - cur;
+    }
+    for (i = 0; i < 2; i++){
+        plzo_buffer_put(win[i].data);
+        plzo_buffer_put(win[i].out);
+        free(win[i].blocks);
+    }
+    plzo_memory_release(need);
+    return status;
+}
+//compresses files into new members, several at a time, each admitted once its buffers fit in the budget
+static int add_members(plzo_pool *pool, struct writer_s *w, char **names, int count, lzo_uint block_size){
+    unsigned long long in_flight = 0;
+    int status = LZO_E_OK;
+    int first = 0;
+    int c;
+    struct member_s *members = (struct member_s *) xmalloc(sizeof(struct member_s) * (count ? count : 1));
+    for (c = 0; c <= count; c++){
+        struct stat st;
+        unsigned long long size = 0;
+        if (c < count && stat(names[c], &st) == 0){
+            size = st.st_size;
+        }
+        unsigned long long need = member_bytes(size, block_size);
+        bool windowed = too_large(need);
+        bool admitted = false;
+        //write out finished members in order until there is room for the next one, a windowed member
+        //waits for all of them as its blocks are appended to the block table directly
+        while (first < c){
+            if (c < count && !windowed && c - first < max_members(pool) && in_flight + size <= max_bytes(pool, block_size)
+                && plzo_memory_try_acquire(need)){
+                admitted = true;
+                break;
+            }
+            struct member_s *m = &members[first++];
+            if (m->job == NULL){
+                continue;
+            }
+            in_flight -= m->size;
+            int r = finish_compress(m, w);
+            if (r != LZO_E_OK){
+                status = r;
+            }
+        }
+        if (c == count){
+            break;
+        }
+        struct member_s *m = &members[c];
+        m->path = names[c];
+        m->size = size;
+        m->data = NULL;
+        m->out = NULL;
+        m->blocks = NULL;
+        m->job = NULL;
+        m->held = 0;
+        if (windowed){
+            FILE *in = fopen(m->path, "rb");
+            if (in == NULL){
+                printf("cannot open %s\n", m->path);
+                status = LZO_E_ERROR;
+                continue;
+            }
+            add_entry(w, m->path);
+            int r = extend_last(pool, w, in, block_size);
+            fclose(in);
+            if (r != LZO_E_OK){
+                printf("parallel comp error %d - %s\n", r, m->path);
+                status = r;
+            }
+            continue;
+        }
+        //nothing of this job is in flight, only other jobs are waited for
+        if (!admitted && plzo_memory_acquire(need) != LZO_E_OK){
+            printf("%s does not fit the memory budget\n", m->path);
+            status = LZO_E_OUT_OF_MEMORY;
+            continue;
+        }
+        m->held = need;
+        if (start_compress(pool, m, block_size)){
+            in_flight += m->size;
+        } else {
+            free_member(m);
+            status = LZO_E_ERROR;
+        }
+    }
+    free(members);
+    return status;
+}
+int plzo_archive_create(plzo_pool *pool, const char *path, char **names, int count, lzo_uint block_size){
+    struct writer_s w;
+    if (block_size == 0){
+        block_size = PLZO_STREAM_BLOCK_SIZE;
+    }
+    if (!writer_create(&w, path)){
+        return LZO_E_ERROR;
+    }
+    int status = add_members(pool, &w, names, count, block_size);
+    int r = writer_finish(&w);
+    if (r != LZO_E_OK){
+        printf("write error - %s\n", path);
+        status = r;
+    }
+    return status;
+}
+int plzo_archive_append(plzo_pool *pool, const char *path, char **names, int count, lzo_uint block_size,
+                        int as_members){
+    struct writer_s w;
+    struct stat st;
+    int status = LZO_E_OK;
+    int c;
+    if (block_size == 0){
+        block_size = PLZO_STREAM_BLOCK_SIZE;
+    }
+    if (stat(path, &st) != 0){ // nothing to append to yet, start a new file
+        if (!writer_create(&w, path)){
+            return LZO_E_ERROR;
+        }
+    } else if (!writer_reopen(&w, path)){
+        return LZO_E_ERROR;
+    }
+    if (as_members){
+        status = add_members(pool, &w, names, count, block_size);
+    } else {
+        if (w.entry_count == 0){
+            add_entry(&w, count > 0 ? names[0] : "-");
+        }
+        for (c = 0; c < count && status == LZO_E_OK; c++){
+            FILE *in = strcmp(names[c], "-") == 0 ? stdin : fopen(names[c], "rb");
+            if (in == NULL){
+                printf("cannot open %s\n", names[c]);
+                status = LZO_E_ERROR;
+                break;
+            }
+            status = extend_last(pool, &w, in, block_size);
+            if (in != stdin){
+                fclose(in);
+            }
+        }
+    }
+    int r = writer_finish(&w);
+    if (r != LZO_E_OK){
+        printf("write error - %s\n", path);
+        status = r;
+    }
+    return status;
+}
+struct plzo_file_writer_s {
+    struct writer_s w;
+    struct plzo_entry_s *entry;
+    int status;
+};
+plzo_file_writer *plzo_file_begin(FILE *file, const char *name){
+    unsigned char header[PLZO_ARCHIVE_HEADER_SIZE];
+    plzo_file_writer *writer = (plzo_file_writer *) xmalloc(sizeof(plzo_file_writer));
+    memset(&writer->w, 0, sizeof(struct writer_s));
+    writer->w.file = file;
+    memcpy(header, PLZO_ARCHIVE_MAGIC, 4);
+    plzo_put_le32(header + 4, PLZO_ARCHIVE_VERSION);
+    writer->status = fwrite(header, 1, PLZO_ARCHIVE_HEADER_SIZE, file) == PLZO_ARCHIVE_HEADER_SIZE ? LZO_E_OK : LZO_E_ERROR;
+    writer->w.offset = PLZO_ARCHIVE_HEADER_SIZE;
+    writer->entry = add_entry(&writer->w, name); // the only entry, never moved
+    return writer;
+}
+int plzo_file_block(plzo_file_writer *writer, struct plzo_block_s *block, unsigned long job, long index){
+    if (writer->status == LZO_E_OK){
+        writer->status = write_block(&writer->w, writer->entry, block, job, index);
+    }
+    return writer->status;
+}
+int plzo_file_end(plzo_file_writer *writer){
+    int r = write_trailer(&writer->w); // the caller keeps the file open
+    int status = writer->status != LZO_E_OK ? writer->status : r;
+    free(writer);
+    return status;
+}
+int plzo_file_write(FILE *file, const char *name, struct plzo_block_s *blocks, int count){
+    plzo_file_writer *writer = plzo_file_begin(file, name);
+    int c;
+    for (c = 0; c < count; c++){
+        plzo_file_block(writer, &blocks[c], 0, c);
+    }
+    return plzo_file_end(writer);
+}
+int plzo_file_compress(plzo_pool *pool, FILE *in, FILE *out, const char *name, lzo_uint block_size){
+    plzo_file_writer *writer = plzo_file_begin(out, name);
+    if (writer->status == LZO_E_OK){
+        writer->status = extend_last(pool, &writer->w, in, block_size ? block_size : PLZO_STREAM_BLOCK_SIZE);
+    }
+    return plzo_file_end(writer);
+}
+//one footer: its trailer holds the table entries of blocks first_block to block_count and the records
+//of members first_entry to entry_count, prev is the end of the trailer before it, 0 if it is complete
+struct footer_s {
+    unsigned long long table_offset;
+    unsigned long long dir_offset;
+    unsigned long long prev;
+    unsigned long long end;
+    unsigned long block_count;
+    unsigned long first_block;
+    int entry_count;
+    int first_entry;
+};
+//reads the footer ending at end, false unless it is consistent on its own
+static bool read_footer(FILE *file, unsigned long long end, struct footer_s *f){
+    unsigned char footer[PLZO_ARCHIVE_FOOTER_SIZE];
+    if (end < PLZO_ARCHIVE_HEADER_SIZE + PLZO_ARCHIVE_FOOTER_SIZE
+        || fseeko(file, end - PLZO_ARCHIVE_FOOTER_SIZE, SEEK_SET) != 0
+        || fread(footer, 1, PLZO_ARCHIVE_FOOTER_SIZE, file) != PLZO_ARCHIVE_FOOTER_SIZE
+        || memcmp(footer + 44, PLZO_ARCHIVE_MAGIC, 4) != 0
+        || plzo_get_le32(footer + 40) != PLZO_ARCHIVE_VERSION){
+        return false;
+    }
+    f->table_offset = plzo_get_le64(footer);
+    f->dir_offset = plzo_get_le64(footer + 8);
+    f->prev = plzo_get_le64(footer + 16);
+    f->end = end;
+    f->block_count = plzo_get_le32(footer + 24);
+    f->entry_count = (int) plzo_get_le32(footer + 28);
+    f->first_block = plzo_get_le32(footer + 32);
+    f->first_entry = (int) plzo_get_le32(footer + 36);
+    return f->table_offset >= PLZO_ARCHIVE_HEADER_SIZE && f->first_block <= f->block_count
+        && f->entry_count >= 0 && f->first_entry >= 0 && f->first_entry <= f->entry_count
+        && f->table_offset + (unsigned long long) (f->block_count - f->first_block) * PLZO_ARCHIVE_INDEX_SIZE == f->dir_offset
+        && f->dir_offset <= end - PLZO_ARCHIVE_FOOTER_SIZE
+        && (f->prev == 0 ? f->first_block == 0 && f->first_entry == 0
+                         : f->prev >= PLZO_ARCHIVE_HEADER_SIZE + PLZO_ARCHIVE_FOOTER_SIZE && f->prev <= f->table_offset);
+}
+//reads the directory records of the trailer of f into entries, replacing older records of the same members
+static bool read_records(FILE *file, const struct footer_s *f, struct plzo_entry_s *entries){
+    lzo_uint dir_len = f->end - PLZO_ARCHIVE_FOOTER_SIZE - f->dir_offset;
+    lzo_bytep dir = (lzo_bytep) xmalloc(dir_len + 1);
+    lzo_uint pos = 0;
+    int c;
+    if (fseeko(file, f->dir_offset, SEEK_SET) != 0 || fread(dir, 1, dir_len, file) != dir_len){
+        free(dir);
+        return false;
+    }
+    for (c = f->first_entry; c < f->entry_count; c++){
+        struct plzo_entry_s *e = &entries[c];
+        lzo_uint len = pos + 2 <= dir_len ? (lzo_uint) dir[pos] | (lzo_uint) dir[pos + 1] << 8 : 0;
+        if (pos + 2 + len + 20 > dir_len){
+            break;
+        }
+        free(e->name);
+        e->name = (char *) xmalloc(len + 1);
+        memcpy(e->name, dir + pos + 2, len);
+        e->name[len] = '\0';
+        pos += 2 + len;
+        e->size = plzo_get_le64(dir + pos);
+        e->first_block = plzo_get_le32(dir + pos + 8);
+        e->block_count = plzo_get_le32(dir + pos + 12);
+        e->checksum = plzo_get_le32(dir + pos + 16);
+        pos += 20;
+        if (e->first_block + e->block_count > f->block_count){
+            break;
+        }
+    }
+    free(dir);
+    return c == f->entry_count && pos == dir_len; // else truncated or inconsistent
+}
+static void free_entries(struct plzo_entry_s *entries, int count){
+    int c;
+    for (c = 0; c < count; c++){
+        free(entries[c].name);
+    }
+    free(entries);
+}
+//reads the footer ending at end and the chain of trailers back to the last complete one, NULL unless
+//all of them are consistent; only the directories are read, the block table is consulted per member
+//on extraction
+static plzo_archive *read_trailer(FILE *file, unsigned long long end){
+    struct footer_s *chain = NULL;
+    int count = 0, size = 0;
+    int c;
+    bool ok = true;
+    do { // newest first, each prev is before the trailer pointing at it so this ends
+        if (count == size){
+            size = size ? size * 2 : 8;
+            struct footer_s *grown = (struct footer_s *) xmalloc(sizeof(struct footer_s) * size);
+            if (count > 0){
+                memcpy(grown, chain, sizeof(struct footer_s) * count);
+            }
+            free(chain);
+            chain = grown;
+        }
+        struct footer_s *f = &chain[count];
+        ok = read_footer(file, count == 0 ? end : chain[count - 1].prev, f);
+        if (ok && count > 0){ // the older trailer covers exactly what the newer one does not repeat
+            ok = f->block_count == chain[count - 1].first_block && f->entry_count >= chain[count - 1].first_entry
+                && f->entry_count <= chain[count - 1].entry_count;
+        }
+        count++;
+    } while (ok && chain[count - 1].prev != 0);
+    if (!ok){
+        free(chain);
+        return NULL;
+    }
+    plzo_archive *archive = (plzo_archive *) xmalloc(sizeof(plzo_archive));
+    archive->file = file;
+    archive->end = end;
+    archive->block_count = chain[0].block_count;
+    archive->entry_count = chain[0].entry_count;
+    archive->entries = (struct plzo_entry_s *) xmalloc(sizeof(struct plzo_entry_s) * (archive->entry_count ? archive->entry_count : 1));
+    memset(archive->entries, 0, sizeof(struct plzo_entry_s) * archive->entry_count);
+    archive->segments = (struct segment_s *) xmalloc(sizeof(struct segment_s) * count);
+    archive->segment_count = 0;
+    archive->delta_bytes = 0;
+    for (c = count - 1; c >= 0 && ok; c--){ // oldest first, so newer records replace older ones
+        ok = read_records(file, &chain[c], archive->entries);
+        if (chain[c].block_count > chain[c].first_block){
+            struct segment_s *seg = &archive->segments[archive->segment_count++];
+            seg->table_offset = chain[c].table_offset;
+            seg->first_block = chain[c].first_block;
+            seg->block_count = chain[c].block_count - chain[c].first_block;
+        }
+        if (chain[c].prev != 0){
+            archive->delta_bytes += chain[c].end - chain[c].table_offset;
+        }
+    }
+    free(chain);
+    if (!ok){
+        free_entries(archive->entries, archive->entry_count);
+        free(archive->segments);
+        free(archive);
+        return NULL;
+    }
+    return archive;
+}
+//the last complete trailer before end, for a file whose append was interrupted before its trailer
+//was written: the old trailer is still in place in front of the new blocks
+static plzo_archive *find_trailer(FILE *file, unsigned long long end){
+    unsigned char buf[65536 + 3];
+    unsigned long long pos = end;
+    size_t keep = 0; // bytes of the previous chunk, a magic may span two chunks
+    while (pos > PLZO_ARCHIVE_HEADER_SIZE){
+        size_t len = pos - PLZO_ARCHIVE_HEADER_SIZE < 65536 ? pos - PLZO_ARCHIVE_HEADER_SIZE : 65536;
+        pos -= len;
+        memmove(buf + len, buf, keep);
+        if (fseeko(file, pos, SEEK_SET) != 0 || fread(buf, 1, len, file) != len){
+            return NULL;
+        }
+        size_t c = len + keep;
+        while (c-- > 3){
+            if (memcmp(buf + c - 3, PLZO_ARCHIVE_MAGIC, 4) == 0){
+                plzo_archive *archive = read_trailer(file, pos + c + 1);
+                if (archive != NULL){
+                    return archive;
+                }
+            }
+        }
+        keep = 3;
+    }
+    return NULL;
+}
+plzo_archive *plzo_archive_open(const char *path){
+    unsigned char header[PLZO_ARCHIVE_HEADER_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL){
+        return NULL;
+    }
+    if (fread(header, 1, PLZO_ARCHIVE_HEADER_SIZE, file) != PLZO_ARCHIVE_HEADER_SIZE
+        || memcmp(header, PLZO_ARCHIVE_MAGIC, 4) != 0 || plzo_get_le32(header + 4) != PLZO_ARCHIVE_VERSION
+        || fseeko(file, 0, SEEK_END) != 0){
+        fclose(file);
+        return NULL;
+    }
+    unsigned long long size = ftello(file);
+    plzo_archive *archive = read_trailer(file, size);
+    if (archive == NULL){
+        archive = find_trailer(file, size);
+        if (archive != NULL){
+            printf("%s: an append was interrupted, its %llu bytes are ignored\n", path, size - archive->end);
+        }
+    }
+    if (archive == NULL){
+        fclose(file);
+    }
+    return archive;
+}
+int plzo_archive_count(const plzo_archive *archive){
+    return archive->entry_count;
+}
+const struct plzo_entry_s *plzo_archive_entry(const plzo_archive *archive, int index){
+    return &archive->entries[index];
+}
+void plzo_archive_close(plzo_archive *archive){
+    if (archive->entries != NULL){
+        free_entries(archive->entries, archive->entry_count);
+    }
+    free(archive->segments);
+    fclose(archive->file);
+    free(archive);
+}
+//refuses names that would land outside the current directory
+static bool safe_name(const char *name){
+    const char *p = name;
+    if (name[0] == '/' || name[0] == '\0'){
+        return false;
+    }
+    while (p != NULL){
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')){
+            return false;
+        }
+        p = strchr(p, '/');
+        if (p != NULL){
+            p++;
+        }
+    }
+    return true;
+}
+static void make_parents(const char *name){
+    char *path = strdup(name);
+    char *p = path;
+    while ((p = strchr(p, '/')) != NULL){
+        *p = '\0';
+        if (mkdir(path, 0777) != 0 && errno != EEXIST){
+            break;
+        }
+        *p++ = '/';
+    }
+    free(path);
+}
+//the segment holding block index, segments are sorted by their first block
+static const struct segment_s *find_segment(const plzo_archive *archive, unsigned long index){
+    int low = 0, high = archive->segment_count - 1;
+    while (low < high){
+        int mid = (low + high + 1) / 2;
+        if (archive->segments[mid].first_block <= index){
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return &archive->segments[low];
+}
+//reads the raw index entries of count blocks from first on, which may span the trailers of several appends
+static bool read_index(plzo_archive *archive, unsigned long first, unsigned long count, lzo_bytep table){
+    while (count > 0){
+        const struct segment_s *seg = find_segment(archive, first);
+        unsigned long skip = first - seg->first_block;
+        unsigned long n = seg->block_count - skip < count ? seg->block_count - skip : count;
+        if (first < seg->first_block || skip >= seg->block_count
+            || fseeko(archive->file, seg->table_offset + (unsigned long long) skip * PLZO_ARCHIVE_INDEX_SIZE, SEEK_SET) != 0
+            || fread(table, PLZO_ARCHIVE_INDEX_SIZE, n, archive->file) != n){
+            return false;
+        }
+        table += n * PLZO_ARCHIVE_INDEX_SIZE;
+        first += n;
+        count -= n;
+    }
+    return true;
+}
+//reads the index entries of count blocks from first on, offsets gets their place in the file and comp and
+//raw their total sizes, false if an entry points outside the block data before its trailer
+static bool load_table(plzo_archive *archive, unsigned long first, unsigned long count, struct plzo_block_s *blocks,
+                       unsigned long long *offsets, unsigned long long *comp, unsigned long long *raw){
+    unsigned long c;
+    lzo_bytep table = (lzo_bytep) xmalloc(count * PLZO_ARCHIVE_INDEX_SIZE + 1);
+    if (!read_index(archive, first, count, table)){
+        free(table);
+        return false;
+    }
+    *comp = 0;
+    *raw = 0;
+    for (c = 0; c < count; c++){
+        lzo_bytep p = table + c * PLZO_ARCHIVE_INDEX_SIZE;
+        lzo_uint data_size = plzo_get_le32(p + 12);
+        lzo_uint out_size = plzo_get_le32(p + 8);
+        offsets[c] = plzo_get_le64(p);
+        if (offsets[c] < PLZO_ARCHIVE_HEADER_SIZE || offsets[c] + data_size > find_segment(archive, first + c)->table_offset){
+            free(table);
+            return false;
+        }
+        blocks[c].data_size = data_size;
+        blocks[c].out_size = out_size;
+        blocks[c].checksum = plzo_get_le32(p + 16);
+        *comp += data_size;
+        *raw += out_size;
+    }
+    free(table);
+    return true;
+}
+//reads the compressed data of blocks found by load_table, one call per run of adjacent blocks, the
+//blocks of a member are only apart where an append left the old trailer between them, NULL if the
+//file is cut short
+static lzo_bytep load_data(plzo_archive *archive, unsigned long count, struct plzo_block_s *blocks,
+                           const unsigned long long *offsets, unsigned long long comp){
+    unsigned long c, run;
+    lzo_bytep data = (lzo_bytep) plzo_buffer_get(comp + 1);
+    lzo_bytep p = data;
+    unsigned long long trace = plzo_trace_begin();
+    for (c = 0; c < count; c = run){
+        lzo_uint len = blocks[c].data_size;
+        for (run = c + 1; run < count && offsets[run] == offsets[c] + len; run++){
+            len += blocks[run].data_size;
+        }
+        if (fseeko(archive->file, offsets[c], SEEK_SET) != 0 || fread(p, 1, len, archive->file) != len){
+            plzo_buffer_put(data);
+            return NULL;
+        }
+        for (; c < run; c++){
+            blocks[c].data = p;
+            p += blocks[c].data_size;
+        }
+    }
+    plzo_trace_end("read", trace, 0, -1, comp);
+    return data;
+}
+lzo_bytep plzo_archive_load(plzo_archive *archive, int index, struct plzo_block_s **blocks){
+    unsigned long long comp, raw;
+    const struct plzo_entry_s *e = &archive->entries[index];
+    unsigned long count = e->block_count;
+    lzo_bytep data = NULL;
+    *blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * (count ? count : 1));
+    unsigned long long *offsets = (unsigned long long *) xmalloc(sizeof(unsigned long long) * (count ? count : 1));
+    if (load_table(archive, e->first_block, count, *blocks, offsets, &comp, &raw) && raw == e->size){
+        data = load_data(archive, count, *blocks, offsets, comp);
+    }
+    free(offsets);
+    if (data == NULL){
+        free(*blocks);
+        *blocks = NULL;
+    }
+    return data;
+}
+//reads the blocks of a member and submits them
+static bool start_extract(plzo_pool *pool, plzo_archive *archive, struct member_s *m){
+    struct plzo_entry_s *e = m->entry;
+    m->count = e->block_count;
+    m->out = NULL;
+    m->data = plzo_archive_load(archive, e - archive->entries, &m->blocks);
+    if (m->data == NULL){
+        return false;
+    }
+    m->out = (lzo_bytep) plzo_buffer_get(e->size + 1);
+    m->job = plzo_batch_submit(pool, PLZO_DECOMPRESS | PLZO_CHECKSUM | PLZO_RESERVED, m->blocks, m->count, m->out, e->size,
+                               NULL, NULL);
+    return true;
+}
+static int finish_extract(struct member_s *m){
+    unsigned long long raw = 0;
+    unsigned long c;
+    unsigned long job = plzo_job_id(m->job);
+    int r = plzo_wait(m->job);
+    plzo_release(m->job);
+    for (c = 0; c < m->count; c++){ // a short block leaves the total below the member size
+        raw += m->blocks[c].out_size;
+    }
+    if (r == LZO_E_OK && raw != m->entry->size){
+        r = LZO_E_ERROR;
+    }
+    if (r != LZO_E_OK){
+        printf("%s is corrupt (%d)\n", m->entry->name, r);
+        free_member(m);
+        return r;
+    }
+    make_parents(m->entry->name);
+    FILE *outfile = fopen(m->entry->name, "wb");
+    unsigned long long trace = plzo_trace_begin();
+    if (outfile == NULL || fwrite(m->out, 1, m->entry->size, outfile) != m->entry->size){
+        printf("cannot write %s\n", m->entry->name);
+        r = LZO_E_ERROR;
+    }
+    plzo_trace_end("write", trace, job, -1, m->entry->size);
+    if (outfile != NULL){
+        fclose(outfile);
+    }
+    free_member(m);
+    return r;
+}
+//budget of a member extracted whole, its compressed size is only known from the block table so the
+//bound of its raw size stands in for it
+static unsigned long long extract_bytes(const struct plzo_entry_s *e){
+    return plzo_buffer_bytes(e->size + 1) + plzo_buffer_bytes(e->size + e->size / 16 + 67ULL * e->block_count + 1);
+}
+//largest compressed and raw block of a member, from its block table read max_blocks entries at a time
+static bool largest_blocks(plzo_archive *archive, const struct plzo_entry_s *e, struct plzo_block_s *blocks,
+                           unsigned long long *offsets, unsigned long max_blocks, lzo_uint *max_comp,
+                           lzo_uint *max_raw){
+    unsigned long done = 0;
+    *max_comp = 0;
+    *max_raw = 0;
+    while (done < e->block_count){
+        unsigned long long comp, raw;
+        unsigned long count = e->block_count - done < max_blocks ? e->block_count - done : max_blocks;
+        unsigned long c;
+        if (!load_table(archive, e->first_block + done, count, blocks, offsets, &comp, &raw)){
+            return false;
+        }
+        for (c = 0; c < count; c++){
+            *max_comp = blocks[c].data_size > *max_comp ? blocks[c].data_size : *max_comp;
+            *max_raw = blocks[c].out_size > *max_raw ? blocks[c].out_size : *max_raw;
+        }
+        done += count;
+    }
+    return true;
+}
+//budget of a window of blocks no larger than the largest ones of the member
+static unsigned long long extract_window_bytes(unsigned long blocks, lzo_uint max_comp, lzo_uint max_raw){
+    return plzo_buffer_bytes(blocks * max_comp + 1) + plzo_buffer_bytes(blocks * max_raw + 1);
+}
+//extracts a member too large for half the budget a window of blocks at a time, as many blocks per window
+//as fit in half the budget when all are as large as the largest block of the member, whatever block
+//size the archive was made with
+static int extract_windowed(plzo_pool *pool, plzo_archive *archive, const struct plzo_entry_s *e){
+    unsigned long max_blocks = max_members(pool);
+    lzo_uint max_comp, max_raw;
+    unsigned long long size = 0;
+    unsigned long done = 0;
+    int r = LZO_E_OK;
+    struct plzo_block_s *blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * max_blocks);
+    unsigned long long *offsets = (unsigned long long *) xmalloc(sizeof(unsigned long long) * max_blocks);
+    if (!largest_blocks(archive, e, blocks, offsets, max_blocks, &max_comp, &max_raw)){
+        printf("%s is corrupt\n", e->name);
+        free(blocks);
+        free(offsets);
+        return LZO_E_ERROR;
+    }
+    while (max_blocks > 1 && too_large(extract_window_bytes(max_blocks, max_comp, max_raw))){
+        max_blocks--;
+    }
+    if (extract_window_bytes(1, max_comp, max_raw) > plzo_memory_limit()){
+        printf("blocks of %s do not fit the memory budget\n", e->name);
+        free(blocks);
+        free(offsets);
+        return LZO_E_OUT_OF_MEMORY;
+    }
+    make_parents(e->name);
+    FILE *outfile = fopen(e->name, "wb");
+    if (outfile == NULL){
+        printf("cannot write %s\n", e->name);
+        free(blocks);
+        free(offsets);
+        return LZO_E_ERROR;
+    }
+    while (done < e->block_count && r == LZO_E_OK){
+        unsigned long long comp, raw;
+        unsigned long count = e->block_count - done < max_blocks ? e->block_count - done : max_blocks;
+        unsigned long c;
+        if (!load_table(archive, e->first_block + done, count, blocks, offsets, &comp, &raw)){
+            r = LZO_E_ERROR;
+            break;
+        }
+        unsigned long long need = plzo_buffer_bytes(comp + 1) + plzo_buffer_bytes(raw + 1);
+        if (plzo_memory_acquire(need) != LZO_E_OK){ // only if the limit was lowered meanwhile
+            r = LZO_E_OUT_OF_MEMORY;
+            break;
+        }
+        lzo_bytep data = load_data(archive, count, blocks, offsets, comp);
+        lzo_bytep out = (lzo_bytep) plzo_buffer_get(raw + 1);
+        if (data == NULL){
+            r = LZO_E_ERROR;
+        } else {
+            plzo_job *job = plzo_batch_submit(pool, PLZO_DECOMPRESS | PLZO_CHECKSUM | PLZO_RESERVED, blocks, count,
+                                              out, raw, NULL, NULL);
+            unsigned long id = plzo_job_id(job);
+            r = plzo_wait(job);
+            plzo_release(job);
+            for (c = 0; c < count; c++){ // a short block leaves the total below the window size
+                raw -= blocks[c].out_size;
+            }
+            if (r == LZO_E_OK && raw != 0){
+                r = LZO_E_ERROR;
+            }
+            unsigned long long trace = plzo_trace_begin();
+            unsigned long long before = size;
+            for (c = 0; c < count && r == LZO_E_OK; c++){
+                if (fwrite(blocks[c].out, 1, blocks[c].out_size, outfile) != blocks[c].out_size){
+                    printf("cannot write %s\n", e->name);
+                    r = LZO_E_ERROR;
+                }
+                size += blocks[c].out_size;
+            }
+            plzo_trace_end("write", trace, id, -1, size - before);
+        }
+        plzo_buffer_put(data);
+        plzo_buffer_put(out);
+        plzo_memory_release(need);
+        done += count;
+    }
+    if (r == LZO_E_OK && size != e->size){
+        r = LZO_E_ERROR;
+    }
+    if (r != LZO_E_OK){
+        printf("%s is corrupt (%d)\n", e->name, r);
+    }
+    free(blocks);
+    free(offsets);
+    fclose(outfile);
+    return r;
+}
+int plzo_archive_extract(plzo_pool *pool, plzo_archive *archive, char **names, int count){
+    int status = LZO_E_OK;
+    int total = count ? count : archive->entry_count;
+    unsigned long long in_flight = 0;
+    int first = 0;
+    int c, i;
+    struct member_s *members = (struct member_s *) xmalloc(sizeof(struct member_s) * (total ? total : 1));
+    for (c = 0; c < total; c++){ // pick the members to extract
+        members[c].entry = NULL;
+        members[c].job = NULL;
+        members[c].held = 0;
+        if (count == 0){
+            members[c].entry = &archive->entries[c];
+        }
+        for (i = 0; count != 0 && i < archive->entry_count; i++){
+            if (strcmp(archive->entries[i].name, names[c]) == 0){
+                members[c].entry = &archive->entries[i];
+                break;
+            }
+        }
+        if (members[c].entry == NULL){
+            printf("%s is not in the archive\n", names[c]);
+            status = LZO_E_ERROR;
+        }
+    }
+    for (c = 0; c <= total; c++){
+        const struct plzo_entry_s *e = c < total ? members[c].entry : NULL;
+        unsigned long long need = e != NULL ? extract_bytes(e) : 0;
+        bool windowed = too_large(need);
+        bool admitted = false;
+        while (first < c){
+            if (c < total && (e == NULL || (!windowed && c - first < max_members(pool)
+                && in_flight + e->size <= max_bytes(pool, PLZO_STREAM_BLOCK_SIZE) && plzo_memory_try_acquire(need)))){
+                admitted = e != NULL;
+                break;
+            }
+            struct member_s *m = &members[first++];
+            if (m->job == NULL){
+                continue;
+            }
+            in_flight -= m->entry->size;
+            int r = finish_extract(m);
+            if (r != LZO_E_OK){
+                status = r;
+            }
+        }
+        if (e == NULL){
+            continue;
+        }
+        struct member_s *m = &members[c];
+        m->path = m->entry->name;
+        if (!safe_name(m->entry->name)){
+            printf("refusing to extract %s\n", m->entry->name);
+            status = LZO_E_ERROR;
+            if (admitted){
+                plzo_memory_release(need);
+            }
+            continue;
+        }
+        if (windowed){
+            int r = extract_windowed(pool, archive, m->entry);
+            if (r != LZO_E_OK){
+                status = r;
+            }
+            continue;
+        }
+        if (!admitted && plzo_memory_acquire(need) != LZO_E_OK){
+            printf("%s does not fit the memory budget\n", m->entry->name);
+            status = LZO_E_OUT_OF_MEMORY;
+            continue;
+        }
+        m->held = need;
+        if (start_extract(pool, archive, m)){
+            in_flight += m->entry->size;
+        } else {
+            printf("%s is corrupt\n", m->entry->name);
+            free_member(m);
+            status = LZO_E_ERROR;
+        }
+    }
+    free(members);
+    return status;
+}
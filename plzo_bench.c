@@ -0,0 +1,1355 @@
+#include <lzo/lzoconf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/sysinfo.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+#include "plzo_bench.h"
+
+//compiler flags are not visible to the program, builds can pass them with -DPLZO_CFLAGS='"-O2 ..."'
+#ifndef PLZO_CFLAGS
+#define PLZO_CFLAGS ""
+#endif
+#if defined(__clang__)
+#define PLZO_COMPILER "clang " __VERSION__
+#elif defined(__GNUC__)
+#define PLZO_COMPILER "gcc " __VERSION__
+#else
+#define PLZO_COMPILER "unknown"
+#endif
+
+//samples of the current run and where they go
+struct report_s {
+    bool active;
+    bool csv;
+    const char *path;
+    struct bench_options_s options;
+    char *command;
+    time_t started;
+    struct bench_sample_s *samples;
+    int count;
+    int size;
+    struct worker_counters_s *workers;
+    int worker_count;
+    int worker_size;
+};
+static struct report_s report;
+//what one worker counted over all timed runs of a point in one direction
+struct worker_counters_s {
+    struct bench_sample_s point;
+    int worker;
+    struct bench_counters_s counters;
+};
+//per worker totals of the last measured point, printed by print_counters
+struct point_counters_s {
+    bool valid;
+    int threads;
+    int runs;
+    unsigned long long raw_bytes;
+    struct bench_counters_s *workers[2]; // compress, decompress
+    struct plzo_worker_stats_s *times[2]; // busy and cpu time of each worker, both directions
+    double elapsed[2]; // wall time of the timed runs, idle is this minus busy
+    bool show_times; // --workers
+#ifdef PLZO_PROBES
+    struct plzo_probes_s *probes; // per worker, both directions of the timed runs
+#endif
+};
+static struct point_counters_s last_counters;
+static void add_worker_counters(const struct bench_sample_s *point);
+//one benchmark input held in memory
+struct bench_input_s {
+    const char *name;
+    lzo_bytep data;
+    lzo_uint len;
+};
+//an input cut into blocks, with arenas for its compressed and its decompressed copy
+struct bench_run_s {
+    struct plzo_block_s *blocks; // raw to compressed
+    struct plzo_block_s *back_blocks; // compressed to raw
+    int count;
+    lzo_bytep comp;
+    lzo_uint comp_size;
+    lzo_bytep back;
+    lzo_bytep local; // copy of the input placed on the nodes that compress it, NULL when in->data is used
+    lzo_uint out_len; // compressed size of the whole input
+};
+
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+unsigned long long bench_parse_size(const char *arg){
+    char *end;
+    unsigned long long size = strtoull(arg, &end, 10);
+    int shift = 0;
+    if (*end == 'k' || *end == 'K'){
+        shift = 10;
+    } else if (*end == 'm' || *end == 'M'){
+        shift = 20;
+    } else if (*end == 'g' || *end == 'G'){
+        shift = 30;
+    }
+    //sizes that overflow stay too large for every limit instead of wrapping around
+    return size > ~0ULL >> shift ? ~0ULL : size << shift;
+}
+//generates a synthetic input given as @kind:size
+static bool make_input(struct bench_input_s *in, const char *name, unsigned long long seed){
+    char kind_name[16];
+    const char *colon = strchr(name, ':');
+    size_t len = colon != NULL ? (size_t) (colon - name - 1) : 0;
+    int kind = -1;
+    if (len > 0 && len < sizeof kind_name){
+        memcpy(kind_name, name + 1, len);
+        kind_name[len] = '\0';
+        kind = corpus_kind(kind_name);
+    }
+    if (kind < 0){
+        printf("unknown synthetic input %s, use @text, @binary, @random, @zero or @mixed with :size\n", name);
+        return false;
+    }
+    in->name = name;
+    in->len = bench_parse_size(colon + 1);
+    in->data = (lzo_bytep) xmalloc(in->len + 1);
+    corpus_fill(kind, seed, 0, in->data, in->len);
+    return true;
+}
+static bool load_input(struct bench_input_s *in, const char *name, unsigned long long seed){
+    if (name[0] == '@'){
+        return make_input(in, name, seed);
+    }
+    FILE *file = fopen(name, "rb");
+    if (file == NULL){
+        printf("cannot open %s\n", name);
+        return false;
+    }
+    fseeko(file, 0, SEEK_END);
+    in->name = name;
+    in->len = ftello(file);
+    rewind(file);
+    in->data = (lzo_bytep) xmalloc(in->len + 1);
+    in->len = fread(in->data, 1, in->len, file);
+    fclose(file);
+    return true;
+}
+//blocks no larger than block_size, but at least one per thread so small files still spread out
+static lzo_uint chunk_size(lzo_uint len, lzo_uint block_size, int threads){
+    lzo_uint size = (len + threads - 1) / threads;
+    if (size > block_size){
+        size = block_size;
+    }
+    return size ? size : 1;
+}
+//with place, every buffer of the run is first touched by the workers of place that will process each block,
+//and the blocks compress a copy of the input made on those nodes
+static void prepare_run(struct bench_run_s *run, const struct bench_input_s *in, lzo_uint chunk, plzo_exec *place){
+    int c;
+    run->count = (in->len + chunk - 1) / chunk;
+    run->blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * (run->count ? run->count : 1));
+    run->back_blocks = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * (run->count ? run->count : 1));
+    for (c = 0; c < run->count; c++){
+        run->blocks[c].data = in->data + c * chunk;
+        run->blocks[c].data_size = c == run->count - 1 ? in->len - c * chunk : chunk;
+    }
+    run->comp_size = plzo_batch_bound(PLZO_COMPRESS, run->blocks, run->count);
+    run->comp = (lzo_bytep) plzo_alloc(run->comp_size + 1);
+    run->back = (lzo_bytep) plzo_alloc(in->len + 1);
+    run->local = NULL;
+    run->out_len = 0;
+    if (place != NULL){
+        run->local = (lzo_bytep) plzo_alloc(in->len + 1);
+        for (c = 0; c < run->count; c++){
+            run->blocks[c].data = run->local + c * chunk;
+            run->back_blocks[c].data = run->back + c * chunk; // the decompression outputs, laid out the same way
+            run->back_blocks[c].data_size = run->blocks[c].data_size;
+            run->back_blocks[c].out_size = 0;
+        }
+        plzo_exec_batch(place, PLZO_TOUCH, run->blocks, run->count, run->comp, run->comp_size);
+        plzo_exec_run(place, PLZO_TOUCH, run->back_blocks, run->count);
+        memcpy(run->local, in->data, in->len);
+    }
+}
+plzo_exec *bench_exec(const struct bench_options_s *opt, int kind, int threads){
+    struct plzo_pool_options_s options;
+    memset(&options, 0, sizeof options);
+    options.numa = opt->numa;
+    options.cpus = opt->cpus;
+    return plzo_exec_create(kind, threads, &options);
+}
+static void free_run(struct bench_run_s *run){
+    free(run->blocks);
+    free(run->back_blocks);
+    plzo_free(run->comp);
+    plzo_free(run->back);
+    plzo_free(run->local);
+}
+static int time_compress(plzo_exec *exec, struct bench_run_s *run, double *seconds){
+    int c;
+    double start = now();
+    int r = plzo_exec_batch(exec, PLZO_COMPRESS, run->blocks, run->count, run->comp, run->comp_size);
+    *seconds = now() - start;
+    run->out_len = 0;
+    for (c = 0; c < run->count; c++){
+        run->out_len += run->blocks[c].out_size;
+    }
+    return r;
+}
+//decompresses the blocks of the last compression and checks the result against the input
+static int time_decompress(plzo_exec *exec, struct bench_run_s *run, const struct bench_input_s *in, double *seconds){
+    int c;
+    for (c = 0; c < run->count; c++){
+        run->back_blocks[c].data = run->blocks[c].out;
+        run->back_blocks[c].data_size = run->blocks[c].out_size;
+        run->back_blocks[c].out_size = run->blocks[c].data_size;
+    }
+    double start = now();
+    int r = plzo_exec_batch(exec, PLZO_DECOMPRESS, run->back_blocks, run->count, run->back, in->len);
+    *seconds = now() - start;
+    if (r == LZO_E_OK && memcmp(run->back, in->data, in->len) != 0){
+        r = LZO_E_ERROR;
+    }
+    return r;
+}
+//evicts a buffer from every cache level of every core, so the next run reads it from memory
+static void flush_range(const void *p, lzo_uint len){
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    const char *end = (const char *) p + len;
+    const char *c;
+    if (line <= 0){
+        line = 64;
+    }
+#if defined(__SSE2__)
+    for (c = (const char *) ((uintptr_t) p & ~(uintptr_t) (line - 1)); c < end; c += line){
+        __builtin_ia32_clflush(c);
+    }
+    __builtin_ia32_mfence();
+#elif defined(__aarch64__)
+    for (c = (const char *) ((uintptr_t) p & ~(uintptr_t) (line - 1)); c < end; c += line){
+        __asm__ volatile("dc civac, %0" : : "r" (c) : "memory");
+    }
+    __asm__ volatile("dsb ish" : : : "memory");
+#else
+    //no flush instruction, stream through a buffer larger than any last level cache instead
+    static volatile unsigned char *sweep = NULL;
+    const lzo_uint sweep_size = 256 * 1024 * 1024;
+    lzo_uint i;
+    (void) c;
+    (void) end;
+    if (sweep == NULL){
+        sweep = (volatile unsigned char *) xmalloc(sweep_size);
+    }
+    for (i = 0; i < sweep_size; i += line){
+        sweep[i]++;
+    }
+#endif
+}
+//lzo_pclock_flush_cpu_cache in lzo_supp.h is a stub, this flushes what a run touches, the node local
+//copy instead of the input when the run has one
+static void flush_run(const struct bench_run_s *run, const struct bench_input_s *in){
+    flush_range(run->local != NULL ? run->local : in->data, in->len);
+    flush_range(run->comp, run->comp_size);
+    flush_range(run->back, in->len);
+}
+//two sided 97.5% quantiles of Student's t distribution for 1 to 30 degrees of freedom
+static const double student_t[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+static int compare_double(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+//median of a sorted array
+static double median_of(const double *sorted, int n){
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+//a sample is an outlier when its modified z-score (Iglewicz and Hoaglin) exceeds 3.5
+static bool is_outlier(double x, double median, double mad){
+    return fabs(0.6745 * (x - median) / mad) > 3.5;
+}
+//summarizes n timings, the confidence interval is computed without the outliers
+static void compute_stats(const double *times, int n, struct bench_stats_s *st){
+    double *sorted = (double *) xmalloc(sizeof(double) * n);
+    double *dev = (double *) xmalloc(sizeof(double) * n);
+    double sum = 0, sq = 0;
+    int inliers = 0;
+    int c;
+    memcpy(sorted, times, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), compare_double);
+    st->runs = n;
+    st->min = sorted[0];
+    st->median = median_of(sorted, n);
+    st->p95 = sorted[(int) ceil(0.95 * n) - 1];
+    for (c = 0; c < n; c++){
+        sum += times[c];
+        dev[c] = fabs(times[c] - st->median);
+    }
+    st->mean = sum / n;
+    for (c = 0; c < n; c++){
+        sq += (times[c] - st->mean) * (times[c] - st->mean);
+    }
+    st->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+    qsort(dev, n, sizeof(double), compare_double);
+    //a floor keeps timer jitter on nearly identical timings from counting as outliers
+    st->mad = median_of(dev, n);
+    if (st->mad < st->median * 0.01){
+        st->mad = st->median * 0.01;
+    }
+    sum = 0;
+    sq = 0;
+    st->outliers = 0;
+    for (c = 0; c < n; c++){
+        if (is_outlier(times[c], st->median, st->mad)){
+            st->outliers++;
+        } else {
+            sum += times[c];
+            inliers++;
+        }
+    }
+    double mean = sum / inliers;
+    for (c = 0; c < n; c++){
+        if (!is_outlier(times[c], st->median, st->mad)){
+            sq += (times[c] - mean) * (times[c] - mean);
+        }
+    }
+    st->ci = 1;
+    if (inliers > 1 && mean > 0){ // half width of the 95% interval of the mean, relative to it
+        double t = inliers - 1 <= 30 ? student_t[inliers - 2] : 1.96;
+        st->ci = t * sqrt(sq / (inliers - 1)) / sqrt(inliers) / mean;
+    }
+    free(sorted);
+    free(dev);
+}
+//adds b to a, a counter stays valid only while both are
+static void add_counters(struct bench_counters_s *a, const struct bench_counters_s *b, bool first){
+    int i;
+    for (i = 0; i < PERF_COUNTERS; i++){
+        a->value[i] += b->value[i];
+        a->valid[i] = (first || a->valid[i]) && b->valid[i];
+    }
+}
+//runs one timed direction (op 0 compress, 1 decompress) with the counters and the time accounting of
+//every worker around it, and adds them to the totals of the point
+static int counted(bench_perf *perf, struct bench_counters_s *workers, int op, int runs, struct bench_counters_s *sum,
+                   double *imbalance, plzo_exec *exec, struct bench_run_s *run, const struct bench_input_s *in,
+                   double *seconds){
+    struct plzo_worker_stats_s stats;
+    int c;
+    memset(sum, 0, sizeof *sum);
+    plzo_exec_stats_reset(exec);
+    if (perf != NULL){
+        perf_start(perf);
+    }
+    int r = op ? time_decompress(exec, run, in, seconds) : time_compress(exec, run, seconds);
+    if (perf != NULL){
+        perf_stop(perf, workers);
+        for (c = 0; c < plzo_exec_threads(exec); c++){
+            add_counters(sum, &workers[c], c == 0);
+            add_counters(&last_counters.workers[op][c], &workers[c], runs == 0);
+        }
+    }
+    *imbalance = plzo_exec_imbalance(exec);
+    for (c = 0; c < plzo_exec_threads(exec); c++){
+        plzo_exec_stats(exec, c, &stats);
+        last_counters.times[op][c].busy += stats.busy;
+        last_counters.times[op][c].cpu += stats.cpu;
+        last_counters.times[op][c].blocks += stats.blocks;
+        last_counters.times[op][c].ranges += stats.ranges;
+    }
+    last_counters.elapsed[op] += *seconds;
+    return r;
+}
+//busy time of the slowest worker over the mean over all runs of a point
+static double point_imbalance(const struct plzo_worker_stats_s *times, int threads){
+    double max = 0, sum = 0;
+    int c;
+    for (c = 0; c < threads; c++){
+        sum += times[c].busy;
+        max = times[c].busy > max ? times[c].busy : max;
+    }
+    return sum > 0 ? max / (sum / threads) : 0;
+}
+//warms up, then compresses and decompresses a prepared run until both confidence intervals are
+//within opt->ci or opt->max_runs is reached, every timed run is also a sample of the report, a
+//point with cache "cold" flushes the buffers before every timed run, the busy time of each worker
+//and with opt->perf its hardware counters are kept as well
+static int measure(plzo_exec *exec, struct bench_run_s *run, const struct bench_input_s *in,
+                   const struct bench_options_s *opt, const struct bench_sample_s *point,
+                   struct bench_stats_s *comp, struct bench_stats_s *decomp){
+    struct bench_sample_s sample = *point;
+    int min_runs = opt->repeat > 0 ? opt->repeat : 5;
+    int max_runs = opt->max_runs > min_runs ? opt->max_runs : min_runs;
+    double target = opt->ci > 0 ? opt->ci : 0.02;
+    double *comp_times = (double *) xmalloc(sizeof(double) * max_runs);
+    double *decomp_times = (double *) xmalloc(sizeof(double) * max_runs);
+    bool cold = point->cache != NULL && strcmp(point->cache, "cold") == 0;
+    int threads = plzo_exec_threads(exec);
+    bench_perf *perf = opt->perf ? perf_open(exec) : NULL;
+    struct bench_counters_s *workers = (struct bench_counters_s *) xmalloc(sizeof(struct bench_counters_s) * threads);
+    struct bench_counters_s *comp_counters = (struct bench_counters_s *) xmalloc(sizeof(struct bench_counters_s) * max_runs);
+    struct bench_counters_s *decomp_counters = (struct bench_counters_s *) xmalloc(sizeof(struct bench_counters_s) * max_runs);
+    double *comp_imbalance = (double *) xmalloc(sizeof(double) * max_runs);
+    double *decomp_imbalance = (double *) xmalloc(sizeof(double) * max_runs);
+    int r = LZO_E_OK;
+    int n = 0;
+    int i;
+    double t;
+    //a run that fails before min_runs leaves zero statistics, never stale or uninitialized ones
+    memset(comp, 0, sizeof(struct bench_stats_s));
+    memset(decomp, 0, sizeof(struct bench_stats_s));
+    for (i = 0; i < 2; i++){
+        free(last_counters.workers[i]);
+        last_counters.workers[i] = (struct bench_counters_s *) xmalloc(sizeof(struct bench_counters_s) * threads);
+        memset(last_counters.workers[i], 0, sizeof(struct bench_counters_s) * threads);
+        free(last_counters.times[i]);
+        last_counters.times[i] = (struct plzo_worker_stats_s *) xmalloc(sizeof(struct plzo_worker_stats_s) * threads);
+        memset(last_counters.times[i], 0, sizeof(struct plzo_worker_stats_s) * threads);
+        last_counters.elapsed[i] = 0;
+    }
+    for (i = 0; i < opt->warmup && r == LZO_E_OK; i++){ // untimed, fills caches and faults in the buffers
+        r = time_compress(exec, run, &t);
+        if (r == LZO_E_OK){
+            r = time_decompress(exec, run, in, &t);
+        }
+    }
+#ifdef PLZO_PROBES
+    if (plzo_exec_pool(exec) != NULL){
+        plzo_pool_probes_reset(plzo_exec_pool(exec));
+    }
+#endif
+    while (r == LZO_E_OK && n < max_runs){
+        if (cold){
+            flush_run(run, in);
+        }
+        r = counted(perf, workers, 0, n, &comp_counters[n], &comp_imbalance[n], exec, run, in, &comp_times[n]);
+        if (r == LZO_E_OK && cold){
+            flush_run(run, in);
+        }
+        if (r == LZO_E_OK){
+            r = counted(perf, workers, 1, n, &decomp_counters[n], &decomp_imbalance[n], exec, run, in,
+                        &decomp_times[n]);
+        }
+        if (r != LZO_E_OK){
+            break;
+        }
+        n++;
+        if (n >= min_runs){
+            compute_stats(comp_times, n, comp);
+            compute_stats(decomp_times, n, decomp);
+            if (comp->ci <= target && decomp->ci <= target){
+                break;
+            }
+        }
+    }
+#ifdef PLZO_PROBES
+    free(last_counters.probes);
+    last_counters.probes = NULL;
+    if (plzo_exec_pool(exec) != NULL){ // only pool workers keep histograms
+        last_counters.probes = (struct plzo_probes_s *) xmalloc(sizeof(struct plzo_probes_s) * threads);
+        for (i = 0; i < threads; i++){
+            plzo_pool_probes(plzo_exec_pool(exec), i, &last_counters.probes[i]);
+        }
+    }
+#endif
+    last_counters.valid = perf != NULL && r == LZO_E_OK && n > 0;
+    last_counters.threads = threads;
+    last_counters.runs = n;
+    last_counters.raw_bytes = in->len;
+    last_counters.show_times = opt->workers;
+    comp->imbalance = point_imbalance(last_counters.times[0], threads);
+    decomp->imbalance = point_imbalance(last_counters.times[1], threads);
+    sample.engine = plzo_exec_name(exec);
+    sample.clock = "wall";
+    sample.pages = plzo_page_kind_name(plzo_pages());
+    sample.threads = threads;
+    sample.blocks = run->count;
+    sample.raw_bytes = in->len;
+    sample.comp_bytes = run->out_len;
+    for (i = 0; r == LZO_E_OK && i < n; i++){
+        sample.run = i;
+        sample.op = "compress";
+        sample.seconds = comp_times[i];
+        sample.outlier = is_outlier(comp_times[i], comp->median, comp->mad);
+        sample.counters = comp_counters[i];
+        sample.imbalance = comp_imbalance[i];
+        bench_report_add(&sample);
+        sample.op = "decompress";
+        sample.seconds = decomp_times[i];
+        sample.outlier = is_outlier(decomp_times[i], decomp->median, decomp->mad);
+        sample.counters = decomp_counters[i];
+        sample.imbalance = decomp_imbalance[i];
+        bench_report_add(&sample);
+    }
+    if (last_counters.valid){
+        add_worker_counters(&sample);
+    }
+    perf_close(perf);
+    free(workers);
+    free(comp_counters);
+    free(decomp_counters);
+    free(comp_imbalance);
+    free(decomp_imbalance);
+    free(comp_times);
+    free(decomp_times);
+    return r;
+}
+//one line of timing statistics in milliseconds
+static void print_stats(const char *label, const struct bench_stats_s *st){
+    printf("%12s\t%6d\t%10.4f\t%10.4f\t%10.4f\t%10.4f\t%7.2f%%\t%8d\t%9.3f\n", label, st->runs, st->min * 1000,
+           st->median * 1000, st->p95 * 1000, st->stddev * 1000, st->ci * 100, st->outliers, st->imbalance);
+}
+static void print_stats_header(void){
+    printf("%12s\t%6s\t%10s\t%10s\t%10s\t%10s\t%8s\t%8s\t%9s\n", "", "runs", "min-ms", "median-ms", "p95-ms",
+           "stddev-ms", "ci95", "outliers", "imbalance");
+}
+static void print_counter(const struct bench_counters_s *c, int i, double scale){
+    if (c->valid[i]){
+        printf("\t%14.0f", c->value[i] * scale);
+    } else {
+        printf("\t%14s", "-");
+    }
+}
+#ifdef PLZO_PROBES
+//upper bound in log2 ticks below which fraction q of the events fall
+static int probe_percentile(const struct plzo_probes_s *p, int kind, double q){
+    unsigned long long seen = 0;
+    int b;
+    for (b = 0; b < PLZO_PROBE_BUCKETS; b++){
+        seen += p->count[kind][b];
+        if (seen >= q * p->events[kind]){
+            break;
+        }
+    }
+    return b + 1;
+}
+//per worker time stamp counter histograms, buckets as log2 ticks:count
+static void print_probes(const struct point_counters_s *pc, const char *label){
+    static const char *kinds[PLZO_PROBE_KINDS] = {"queue", "codec", "checksum", "handoff"};
+    int k, c, b;
+    printf("  %-16s\t%6s\t%10s\t%14s\t%6s\t%6s\t%s\n", label, "worker", "events", "mean-ticks", "p50<", "p99<",
+           "log2 ticks:count");
+    for (k = 0; k < PLZO_PROBE_KINDS; k++){
+        for (c = 0; c < pc->threads; c++){
+            const struct plzo_probes_s *p = &pc->probes[c];
+            if (p->events[k] == 0){
+                continue;
+            }
+            printf("  %-16s\t%6d\t%10llu\t%14.0f\t2^%-4d\t2^%-4d\t", kinds[k], c, p->events[k],
+                   (double) p->ticks[k] / p->events[k], probe_percentile(p, k, 0.5), probe_percentile(p, k, 0.99));
+            for (b = 0; b < PLZO_PROBE_BUCKETS; b++){
+                if (p->count[k][b] > 0){
+                    printf(" %d:%llu", b, p->count[k][b]);
+                }
+            }
+            printf("\n");
+        }
+    }
+}
+#endif
+//hardware counters of a point, means per run for each worker and all of them
+static void print_perf(const struct point_counters_s *pc, const char *label){
+    static const char *ops[2] = {"compress", "decompress"};
+    double scale = 1.0 / pc->runs;
+    int op, c, i;
+    if (!pc->valid){
+        return;
+    }
+    printf("  %-16s\t%6s\t%14s\t%14s\t%6s\t%14s\t%14s\t%14s\n", label, "worker", "cycles", "instructions", "ipc",
+           "llc-misses", "branch-misses", "dtlb-misses");
+    for (op = 0; op < 2; op++){
+        struct bench_counters_s all;
+        memset(&all, 0, sizeof all);
+        for (c = 0; c <= pc->threads; c++){
+            const struct bench_counters_s *w = c < pc->threads ? &pc->workers[op][c] : &all;
+            if (c < pc->threads){
+                add_counters(&all, w, c == 0);
+                printf("  %-16s\t%6d", ops[op], c);
+            } else {
+                printf("  %-16s\t%6s", ops[op], "all");
+            }
+            print_counter(w, PERF_CYCLES, scale);
+            print_counter(w, PERF_INSTRUCTIONS, scale);
+            if (w->valid[PERF_CYCLES] && w->valid[PERF_INSTRUCTIONS] && w->value[PERF_CYCLES] > 0){
+                printf("\t%6.2f", (double) w->value[PERF_INSTRUCTIONS] / w->value[PERF_CYCLES]);
+            } else {
+                printf("\t%6s", "-");
+            }
+            for (i = PERF_LLC_MISSES; i < PERF_COUNTERS; i++){
+                print_counter(w, i, scale);
+            }
+            printf("\n");
+        }
+        //per KB of input, what tells a miss bound run from a bandwidth bound one
+        printf("  %-16s\t%6s", ops[op], "per KB");
+        for (i = 0; i < PERF_COUNTERS; i++){
+            if (i == PERF_LLC_MISSES){
+                printf("\t%6s", "");
+            }
+            if (all.valid[i]){
+                printf("\t%14.2f", all.value[i] * scale / (pc->raw_bytes / 1024.0));
+            } else {
+                printf("\t%14s", "-");
+            }
+        }
+        printf("\n");
+    }
+}
+//mean busy, cpu and idle time per run of every worker, idle is the elapsed time it did not work
+static void print_times(const struct point_counters_s *pc, const char *label){
+    static const char *ops[2] = {"compress", "decompress"};
+    int op, c;
+    printf("  %-16s\t%6s\t%10s\t%10s\t%10s\t%10s\t%8s\n", label, "worker", "blocks", "busy-ms", "cpu-ms", "idle-ms",
+           "busy%");
+    for (op = 0; op < 2; op++){
+        double elapsed = pc->elapsed[op] / pc->runs;
+        for (c = 0; c < pc->threads; c++){
+            const struct plzo_worker_stats_s *w = &pc->times[op][c];
+            double busy = w->busy / pc->runs;
+            printf("  %-16s\t%6d\t%10.1f\t%10.4f\t%10.4f\t%10.4f\t%7.1f%%\n", ops[op], c, (double) w->blocks / pc->runs,
+                   busy * 1000, w->cpu / pc->runs * 1000, (elapsed > busy ? elapsed - busy : 0) * 1000,
+                   elapsed > 0 ? busy / elapsed * 100 : 0);
+        }
+        printf("  %-16s\t%6s\t%10s\t%10s\t%10s\t%10s\t%8s\timbalance %.3f\n", ops[op], "", "", "", "", "", "",
+               point_imbalance(pc->times[op], pc->threads));
+    }
+}
+//what was counted during a point, the worker times with --workers, the probe histograms when built
+//with them and the hardware counters
+static void print_counters(const struct point_counters_s *pc, const char *label){
+    if (pc->show_times && pc->runs > 0){
+        print_times(pc, label);
+    }
+#ifdef PLZO_PROBES
+    if (pc->runs > 0 && pc->probes != NULL){
+        print_probes(pc, label);
+    }
+#endif
+    print_perf(pc, label);
+}
+//takes over the counters of the last point so the next one does not overwrite them
+static struct point_counters_s keep_counters(void){
+    struct point_counters_s pc = last_counters;
+    last_counters.workers[0] = NULL;
+    last_counters.workers[1] = NULL;
+    last_counters.times[0] = NULL;
+    last_counters.times[1] = NULL;
+#ifdef PLZO_PROBES
+    last_counters.probes = NULL;
+#endif
+    return pc;
+}
+static void free_counters(struct point_counters_s *pc){
+    free(pc->workers[0]);
+    free(pc->workers[1]);
+    free(pc->times[0]);
+    free(pc->times[1]);
+#ifdef PLZO_PROBES
+    free(pc->probes);
+#endif
+}
+//starts a new peak resident set measurement, Linux resets VmHWM when 5 is written to clear_refs
+static void reset_peak_rss(void){
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file != NULL){
+        fputs("5", file);
+        fclose(file);
+    }
+}
+//peak resident set in bytes since the last reset, or since the start when resetting is not supported
+static unsigned long long peak_rss(void){
+    char line[128];
+    unsigned long long kb = 0;
+    FILE *file = fopen("/proc/self/status", "r");
+    while (file != NULL && fgets(line, sizeof line, file) != NULL){
+        if (strncmp(line, "VmHWM:", 6) == 0){
+            kb = strtoull(line + 6, NULL, 10);
+            break;
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+    if (kb == 0){
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        kb = usage.ru_maxrss;
+    }
+    return kb * 1024;
+}
+//bytes of the process backed by transparent huge pages, 0 when smaps_rollup is missing (before Linux 4.14)
+static unsigned long long anon_huge(void){
+    char line[128];
+    unsigned long long kb = 0;
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    while (file != NULL && fgets(line, sizeof line, file) != NULL){
+        if (strncmp(line, "AnonHugePages:", 14) == 0){
+            kb = strtoull(line + 14, NULL, 10);
+            break;
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+    return kb * 1024;
+}
+//Karp-Flatt metric, the serial fraction implied by one speedup measurement
+static double karp_flatt(double speedup, int threads){
+    return (1.0 / speedup - 1.0 / threads) / (1.0 - 1.0 / threads);
+}
+//least squares fit of Amdahl's law t(p) = t(1) * (f + (1 - f) / p) over the sweep
+static double serial_fraction(const double *times, const int *threads, int n){
+    double sxy = 0, sxx = 0;
+    int c;
+    for (c = 0; c < n; c++){
+        if (threads[c] > 1){
+            double x = 1.0 - 1.0 / threads[c];
+            double y = times[c] / times[0] - 1.0 / threads[c];
+            sxy += x * y;
+            sxx += x * x;
+        }
+    }
+    if (sxx == 0){
+        return 0;
+    }
+    double f = sxy / sxx;
+    return f < 0 ? 0 : f > 1 ? 1 : f;
+}
+static void print_point(const char *label, double seconds, double t1, int threads, lzo_uint len){
+    double speedup = t1 / seconds;
+    printf("%10.4f\t%10.1f\t%8.2f\t%8.2f\t", seconds * 1000, len / seconds / 1e6, speedup, speedup / threads);
+    if (threads > 1){
+        printf("%8.4f", karp_flatt(speedup, threads));
+    } else {
+        printf("%8s", "-");
+    }
+    printf("%s", label);
+}
+int bench_scale(const struct bench_options_s *opt, char **names, int count){
+    int max = opt->exec == PLZO_EXEC_SERIAL ? 1 : opt->threads > 0 ? opt->threads : plzo_cpu_threads(opt->cpus);
+    int status = LZO_E_OK;
+    int n = 0;
+    int c, f;
+    //1, 2, 4 ... and the maximum itself when it is not a power of two
+    int *threads = (int *) xmalloc(sizeof(int) * 34);
+    for (c = 1; c < max; c *= 2){
+        threads[n++] = c;
+    }
+    threads[n++] = max;
+    plzo_exec **execs = (plzo_exec **) xmalloc(sizeof(plzo_exec *) * n);
+    for (c = 0; c < n; c++){
+        execs[c] = bench_exec(opt, opt->exec, threads[c]);
+        if (execs[c] == NULL){
+            while (c-- > 0){
+                plzo_exec_destroy(execs[c]);
+            }
+            free(execs);
+            free(threads);
+            return LZO_E_ERROR;
+        }
+        threads[c] = plzo_exec_threads(execs[c]); // an OpenMP team may have started smaller
+    }
+    double *comp = (double *) xmalloc(sizeof(double) * n);
+    double *decomp = (double *) xmalloc(sizeof(double) * n);
+    struct bench_stats_s *comp_stats = (struct bench_stats_s *) xmalloc(sizeof(struct bench_stats_s) * n);
+    struct bench_stats_s *decomp_stats = (struct bench_stats_s *) xmalloc(sizeof(struct bench_stats_s) * n);
+    double *comp_total = (double *) xmalloc(sizeof(double) * n);
+    double *decomp_total = (double *) xmalloc(sizeof(double) * n);
+    struct point_counters_s *counters = (struct point_counters_s *) xmalloc(sizeof(struct point_counters_s) * n);
+    unsigned long long total_len = 0;
+    for (c = 0; c < n; c++){
+        comp_total[c] = 0;
+        decomp_total[c] = 0;
+    }
+    printf("thread scaling, %s executor, up to %d threads, block size %lu, median of timed runs, wall clock\n",
+           plzo_exec_name(execs[0]), max, (unsigned long) opt->block_size);
+    for (f = 0; f < count; f++){
+        struct bench_input_s in;
+        if (!load_input(&in, names[f], opt->seed)){
+            status = LZO_E_ERROR;
+            continue;
+        }
+        lzo_uint out_len = 0;
+        for (c = 0; c < n; c++){
+            struct bench_run_s run;
+            struct bench_sample_s point;
+            memset(&point, 0, sizeof point);
+            point.bench = "scale";
+            point.file = in.name;
+            point.cache = "hot";
+            point.block_size = chunk_size(in.len, opt->block_size, threads[c]);
+            prepare_run(&run, &in, point.block_size, opt->numa ? execs[c] : NULL);
+            int r = measure(execs[c], &run, &in, opt, &point, &comp_stats[c], &decomp_stats[c]);
+            counters[c] = keep_counters();
+            if (r != LZO_E_OK){
+                printf("%s failed with %d threads (%d)\n", in.name, threads[c], r);
+                status = r;
+            }
+            comp[c] = comp_stats[c].median;
+            decomp[c] = decomp_stats[c].median;
+            if (c == 0){
+                out_len = run.out_len;
+            }
+            comp_total[c] += comp[c];
+            decomp_total[c] += decomp[c];
+            free_run(&run);
+        }
+        total_len += in.len;
+        printf("\nfile is %s, %lu bytes, ratio %.4f\n", in.name, (unsigned long) in.len,
+               in.len ? (double) out_len / in.len : 0);
+        printf("%7s\t%10s\t%10s\t%8s\t%8s\t%8s\t%10s\t%10s\t%8s\t%8s\t%8s\n", "threads",
+               "comp-ms", "comp-MB/s", "speedup", "effic.", "serial", "decomp-ms", "decomp-MB/s", "speedup", "effic.", "serial");
+        for (c = 0; c < n; c++){
+            printf("%7d\t", threads[c]);
+            print_point("\t", comp[c], comp[0], threads[c], in.len);
+            print_point("\n", decomp[c], decomp[0], threads[c], in.len);
+        }
+        printf("amdahl serial fraction: comp %.4f, decomp %.4f\n",
+               serial_fraction(comp, threads, n), serial_fraction(decomp, threads, n));
+        print_stats_header();
+        for (c = 0; c < n; c++){
+            char label[32];
+            snprintf(label, sizeof label, "comp %d", threads[c]);
+            print_stats(label, &comp_stats[c]);
+            snprintf(label, sizeof label, "decomp %d", threads[c]);
+            print_stats(label, &decomp_stats[c]);
+        }
+        for (c = 0; c < n; c++){
+            char label[32];
+            snprintf(label, sizeof label, "%d threads", threads[c]);
+            print_counters(&counters[c], label);
+            free_counters(&counters[c]);
+        }
+        free(in.data);
+    }
+    if (count > 1){
+        printf("\nall files, %llu bytes\n", total_len);
+        for (c = 0; c < n; c++){
+            printf("%7d\t", threads[c]);
+            print_point("\t", comp_total[c], comp_total[0], threads[c], total_len);
+            print_point("\n", decomp_total[c], decomp_total[0], threads[c], total_len);
+        }
+        printf("amdahl serial fraction: comp %.4f, decomp %.4f\n",
+               serial_fraction(comp_total, threads, n), serial_fraction(decomp_total, threads, n));
+    }
+    for (c = 0; c < n; c++){
+        plzo_exec_destroy(execs[c]);
+    }
+    free(execs);
+    free(threads);
+    free(comp);
+    free(decomp);
+    free(comp_stats);
+    free(decomp_stats);
+    free(comp_total);
+    free(decomp_total);
+    free(counters);
+    return status;
+}
+int bench_mem(const struct bench_options_s *opt, char **names, int count){
+    static const char *caches[2] = {"hot", "cold"};
+    int status = LZO_E_OK;
+    int f, c;
+    plzo_exec *exec = bench_exec(opt, opt->exec, opt->threads > 0 ? opt->threads : plzo_cpu_threads(opt->cpus));
+    if (exec == NULL){
+        return LZO_E_ERROR;
+    }
+    int threads = plzo_exec_threads(exec);
+    printf("in-memory throughput, %s executor, %d threads, block size %lu, median of timed runs, wall clock\n",
+           plzo_exec_name(exec), threads, (unsigned long) opt->block_size);
+    for (f = 0; f < count; f++){
+        struct bench_input_s in;
+        struct bench_run_s run;
+        if (!load_input(&in, names[f], opt->seed)){
+            status = LZO_E_ERROR;
+            continue;
+        }
+        prepare_run(&run, &in, chunk_size(in.len, opt->block_size, threads), opt->numa ? exec : NULL);
+        printf("\nfile is %s, %lu bytes, %d blocks\n", in.name, (unsigned long) in.len, run.count);
+        printf("%6s\t%10s\t%10s\t%10s\t%10s\t%10s\t%10s\t%7s\t%11s\n", "cache", "comp-ms", "comp-GB/s", "per-core",
+               "decomp-ms", "decomp-GB/s", "per-core", "ci95", "imbalance");
+        for (c = 0; c < 2; c++){
+            struct bench_sample_s point;
+            struct bench_stats_s comp, decomp;
+            memset(&point, 0, sizeof point);
+            point.bench = "mem";
+            point.file = in.name;
+            point.cache = caches[c];
+            point.block_size = chunk_size(in.len, opt->block_size, threads);
+            int r = measure(exec, &run, &in, opt, &point, &comp, &decomp);
+            if (r != LZO_E_OK){
+                printf("%s failed (%d)\n", in.name, r);
+                status = r;
+                break;
+            }
+            double comp_gbs = in.len / comp.median / 1e9;
+            double decomp_gbs = in.len / decomp.median / 1e9;
+            printf("%6s\t%10.4f\t%10.3f\t%10.3f\t%10.4f\t%10.3f\t%10.3f\t%6.2f%%\t%5.2f/%5.2f\n", caches[c],
+                   comp.median * 1000, comp_gbs, comp_gbs / threads, decomp.median * 1000, decomp_gbs, decomp_gbs / threads,
+                   (comp.ci > decomp.ci ? comp.ci : decomp.ci) * 100, comp.imbalance, decomp.imbalance);
+            print_counters(&last_counters, caches[c]);
+        }
+        free_run(&run);
+        free(in.data);
+    }
+    plzo_exec_destroy(exec);
+    return status;
+}
+int bench_blocks(const struct bench_options_s *opt, char **names, int count){
+    lzo_uint min = opt->min_block ? opt->min_block : 16 * 1024;
+    lzo_uint max = opt->max_block ? opt->max_block : 64 * 1024 * 1024;
+    int status = LZO_E_OK;
+    int f;
+    plzo_exec *exec = bench_exec(opt, opt->exec, opt->threads > 0 ? opt->threads : plzo_cpu_threads(opt->cpus));
+    if (exec == NULL){
+        return LZO_E_ERROR;
+    }
+    int threads = plzo_exec_threads(exec);
+    printf("block size sweep, %s executor, %d threads, median of timed runs, wall clock\n", plzo_exec_name(exec), threads);
+    for (f = 0; f < count; f++){
+        struct bench_input_s in;
+        lzo_uint block;
+        if (!load_input(&in, names[f], opt->seed)){
+            status = LZO_E_ERROR;
+            continue;
+        }
+        printf("\nfile is %s, %lu bytes\n", in.name, (unsigned long) in.len);
+        printf("%10s\t%8s\t%10s\t%10s\t%10s\t%10s\t%10s\t%6s\t%7s\t%8s\t%11s\n", "block", "blocks", "ratio",
+               "comp-ms", "comp-MB/s", "decomp-MB/s", "peak-MiB", "runs", "ci95", "outliers", "imbalance");
+        for (block = min; block <= max; block *= 2){
+            struct bench_run_s run;
+            struct bench_sample_s point;
+            struct bench_stats_s comp, decomp;
+            int first = report.count;
+            memset(&point, 0, sizeof point);
+            point.bench = "blocks";
+            point.file = in.name;
+            point.cache = "hot";
+            point.block_size = block;
+            reset_peak_rss();
+            prepare_run(&run, &in, block, opt->numa ? exec : NULL);
+            int r = measure(exec, &run, &in, opt, &point, &comp, &decomp);
+            unsigned long long peak = peak_rss();
+            for (; first < report.count; first++){
+                report.samples[first].peak_rss = peak;
+            }
+            if (r != LZO_E_OK){
+                printf("%s failed with %lu byte blocks (%d)\n", in.name, (unsigned long) block, r);
+                status = r;
+            } else {
+                double ci = comp.ci > decomp.ci ? comp.ci : decomp.ci;
+                printf("%10lu\t%8d\t%10.6f\t%10.4f\t%10.1f\t%10.1f\t%10.1f\t%6d\t%6.2f%%\t%8d\t%5.2f/%5.2f\n",
+                       (unsigned long) block, run.count, in.len ? (double) run.out_len / in.len : 0, comp.median * 1000,
+                       in.len / comp.median / 1e6, in.len / decomp.median / 1e6, peak / 1048576.0, comp.runs, ci * 100,
+                       comp.outliers + decomp.outliers, comp.imbalance, decomp.imbalance);
+                char label[32];
+                snprintf(label, sizeof label, "%lu byte blocks", (unsigned long) block);
+                print_counters(&last_counters, label);
+            }
+            free_run(&run);
+            if (block >= in.len){ // larger blocks would all be this single block again
+                break;
+            }
+        }
+        free(in.data);
+    }
+    plzo_exec_destroy(exec);
+    return status;
+}
+int bench_sched(const struct bench_options_s *opt, char **names, int count){
+    //NULL is the pool, the reference every schedule is held against
+    static const char *schedules[] = {"static", "static,1", "dynamic,1", "dynamic,4", "guided", NULL};
+    int threads = opt->threads > 0 ? opt->threads : plzo_cpu_threads(opt->cpus);
+    int status = LZO_E_OK;
+    int f, c;
+    plzo_exec *team = bench_exec(opt, PLZO_EXEC_OPENMP, threads);
+    if (team == NULL){
+        return LZO_E_ERROR;
+    }
+    plzo_exec *pool = bench_exec(opt, PLZO_EXEC_POOL, threads);
+    threads = plzo_exec_threads(team);
+    printf("OpenMP schedules, %d threads, block size %lu, median of timed runs, wall clock\n",
+           threads, (unsigned long) opt->block_size);
+    for (f = 0; f < count; f++){
+        struct bench_input_s in;
+        struct bench_run_s run;
+        if (!load_input(&in, names[f], opt->seed)){
+            status = LZO_E_ERROR;
+            continue;
+        }
+        //at least 8 blocks per thread, a schedule has nothing to balance with one block each
+        lzo_uint chunk = chunk_size(in.len, opt->block_size, threads * 8);
+        prepare_run(&run, &in, chunk, opt->numa ? pool : NULL);
+        printf("\nfile is %s, %lu bytes, %d blocks\n", in.name, (unsigned long) in.len, run.count);
+        printf("%10s\t%10s\t%10s\t%10s\t%10s\t%7s\t%11s\n", "schedule", "comp-ms", "comp-MB/s",
+               "decomp-ms", "decomp-MB/s", "ci95", "imbalance");
+        for (c = 0; c < (int) (sizeof schedules / sizeof schedules[0]); c++){
+            struct bench_sample_s point;
+            struct bench_stats_s comp, decomp;
+            const char *label = schedules[c] != NULL ? schedules[c] : "pool";
+            plzo_exec *exec = schedules[c] != NULL ? team : pool;
+            if (schedules[c] != NULL){
+                plzo_exec_schedule(team, schedules[c]);
+            }
+            memset(&point, 0, sizeof point);
+            point.bench = "sched";
+            point.file = in.name;
+            point.cache = "hot";
+            point.block_size = chunk;
+            point.schedule = schedules[c];
+            int r = measure(exec, &run, &in, opt, &point, &comp, &decomp);
+            if (r != LZO_E_OK){
+                printf("%s failed with %s (%d)\n", in.name, label, r);
+                status = r;
+                break;
+            }
+            printf("%10s\t%10.4f\t%10.1f\t%10.4f\t%10.1f\t%6.2f%%\t%5.2f/%5.2f\n", label, comp.median * 1000,
+                   in.len / comp.median / 1e6, decomp.median * 1000, in.len / decomp.median / 1e6,
+                   (comp.ci > decomp.ci ? comp.ci : decomp.ci) * 100, comp.imbalance, decomp.imbalance);
+            print_counters(&last_counters, label);
+        }
+        free_run(&run);
+        free(in.data);
+    }
+    plzo_exec_destroy(team);
+    plzo_exec_destroy(pool);
+    return status;
+}
+int bench_pages(const struct bench_options_s *opt, char **names, int count){
+    int threads = opt->threads > 0 ? opt->threads : plzo_cpu_threads(opt->cpus);
+    int mode = plzo_pages();
+    int status = LZO_E_OK;
+    int f, c;
+    printf("page kinds, %s executor, %d threads, median of timed runs, wall clock, delta against small pages\n",
+           plzo_exec_kind_name(opt->exec), threads);
+    for (f = 0; f < count && status == LZO_E_OK; f++){
+        struct bench_input_s in;
+        double comp_small = 0, decomp_small = 0;
+        if (!load_input(&in, names[f], opt->seed)){
+            status = LZO_E_ERROR;
+            continue;
+        }
+        lzo_uint chunk = chunk_size(in.len, opt->block_size, threads);
+        printf("\nfile is %s, %lu bytes, block size %lu\n", in.name, (unsigned long) in.len, (unsigned long) chunk);
+        printf("%8s\t%8s\t%10s\t%7s\t%10s\t%7s\t%7s\t%8s\n", "pages", "got", "comp-MB/s", "delta",
+               "decomp-MB/s", "delta", "ci95", "thp-MB");
+        for (c = 0; c < PLZO_PAGE_KINDS; c++){
+            struct bench_run_s run;
+            struct bench_sample_s point;
+            struct bench_stats_s comp, decomp;
+            //the executor is made after the mode is set, so its work memory gets the same pages as the blocks
+            plzo_set_pages(c);
+            plzo_exec *exec = bench_exec(opt, opt->exec, threads);
+            if (exec == NULL){
+                status = LZO_E_ERROR;
+                break;
+            }
+            //the blocks run on a copy of the input, which only then is in pages of this kind too
+            prepare_run(&run, &in, chunk, exec);
+            const char *got = plzo_page_bytes(PLZO_PAGES_HUGETLB) > 0 ? "hugetlb" :
+                              plzo_page_bytes(PLZO_PAGES_THP) > 0 ? "thp" : "small";
+            memset(&point, 0, sizeof point);
+            point.bench = "pages";
+            point.file = in.name;
+            point.cache = "hot";
+            point.block_size = chunk;
+            int r = measure(exec, &run, &in, opt, &point, &comp, &decomp);
+            if (r != LZO_E_OK){
+                printf("%s failed with %s pages (%d)\n", in.name, plzo_page_kind_name(c), r);
+                status = r;
+            } else {
+                if (c == PLZO_PAGES_SMALL){
+                    comp_small = comp.median;
+                    decomp_small = decomp.median;
+                }
+                printf("%8s\t%8s\t%10.1f\t%+6.1f%%\t%10.1f\t%+6.1f%%\t%6.2f%%\t%8.1f\n", plzo_page_kind_name(c), got,
+                       in.len / comp.median / 1e6, (comp_small / comp.median - 1) * 100,
+                       in.len / decomp.median / 1e6, (decomp_small / decomp.median - 1) * 100,
+                       (comp.ci > decomp.ci ? comp.ci : decomp.ci) * 100, anon_huge() / 1e6);
+                print_counters(&last_counters, plzo_page_kind_name(c));
+            }
+            free_run(&run);
+            plzo_exec_destroy(exec);
+            if (r != LZO_E_OK){
+                break;
+            }
+        }
+        free(in.data);
+    }
+    plzo_set_pages(mode);
+    return status;
+}
+int bench_report_start(const char *format, const char *path, const struct bench_options_s *opt, int argc, char **argv){
+    size_t len = 1;
+    int c;
+    if (strcmp(format, "json") != 0 && strcmp(format, "csv") != 0){
+        printf("unknown report format %s\n", format);
+        return LZO_E_ERROR;
+    }
+    report.active = true;
+    report.csv = strcmp(format, "csv") == 0;
+    report.path = path != NULL ? path : report.csv ? "results_bench.csv" : "results_bench.json";
+    report.options = *opt;
+    report.started = time(NULL);
+    for (c = 0; c < argc; c++){
+        len += strlen(argv[c]) + 1;
+    }
+    report.command = (char *) xmalloc(len);
+    report.command[0] = '\0';
+    for (c = 0; c < argc; c++){
+        if (c > 0){
+            strcat(report.command, " ");
+        }
+        strcat(report.command, argv[c]);
+    }
+    return LZO_E_OK;
+}
+void bench_report_add(const struct bench_sample_s *sample){
+    if (!report.active){
+        return;
+    }
+    if (report.count == report.size){
+        report.size = report.size ? report.size * 2 : 256;
+        struct bench_sample_s *samples = (struct bench_sample_s *) xmalloc(sizeof(struct bench_sample_s) * report.size);
+        if (report.count > 0){
+            memcpy(samples, report.samples, sizeof(struct bench_sample_s) * report.count);
+        }
+        free(report.samples);
+        report.samples = samples;
+    }
+    report.samples[report.count++] = *sample;
+}
+//keeps the per worker totals of the last point for the json report
+static void add_worker_counters(const struct bench_sample_s *point){
+    int op, c;
+    if (!report.active){
+        return;
+    }
+    for (op = 0; op < 2; op++){
+        for (c = 0; c < last_counters.threads; c++){
+            if (report.worker_count == report.worker_size){
+                report.worker_size = report.worker_size ? report.worker_size * 2 : 64;
+                struct worker_counters_s *workers =
+                    (struct worker_counters_s *) xmalloc(sizeof(struct worker_counters_s) * report.worker_size);
+                if (report.worker_count > 0){
+                    memcpy(workers, report.workers, sizeof(struct worker_counters_s) * report.worker_count);
+                }
+                free(report.workers);
+                report.workers = workers;
+            }
+            struct worker_counters_s *w = &report.workers[report.worker_count++];
+            w->point = *point;
+            w->point.op = op ? "decompress" : "compress";
+            w->point.run = last_counters.runs;
+            w->worker = c;
+            w->counters = last_counters.workers[op][c];
+        }
+    }
+}
+//first "model name" of /proc/cpuinfo
+static void cpu_model(char *model, size_t size){
+    char line[256];
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    snprintf(model, size, "unknown");
+    while (file != NULL && fgets(line, sizeof line, file) != NULL){
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon != NULL){
+            colon += strspn(colon + 1, " \t") + 1;
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(model, size, "%s", colon);
+            break;
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+}
+//writes s as a json string, or as a csv field when csv is set
+static void put_string(FILE *out, const char *s, bool csv){
+    fputc('"', out);
+    for (; s != NULL && *s != '\0'; s++){
+        if (*s == '"'){
+            fputs(csv ? "\"\"" : "\\\"", out);
+        } else if (!csv && *s == '\\'){
+            fputs("\\\\", out);
+        } else if (!csv && (unsigned char) *s < 0x20){
+            fprintf(out, "\\u%04x", (unsigned char) *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+//the valid counters as a json object, null when there are none
+static void put_counters(FILE *out, const struct bench_counters_s *counters){
+    bool any = false;
+    int i;
+    for (i = 0; i < PERF_COUNTERS; i++){
+        if (counters->valid[i]){
+            fprintf(out, "%s\"%s\": %llu", any ? ", " : "{", perf_names[i], counters->value[i]);
+            any = true;
+        }
+    }
+    fputs(any ? "}" : "null", out);
+}
+static void write_json(FILE *out, const struct utsname *host, const char *model, const char *stamp){
+    int c;
+    fprintf(out, "{\n  \"schema\": \"%s\",\n  \"timestamp\": \"%s\",\n  \"command\": ", BENCH_SCHEMA, stamp);
+    put_string(out, report.command, false);
+    fprintf(out, ",\n  \"host\": {\n    \"name\": ");
+    put_string(out, host->nodename, false);
+    fprintf(out, ",\n    \"cpu\": ");
+    put_string(out, model, false);
+    fprintf(out, ",\n    \"online_cpus\": %d,\n    \"configured_cpus\": %d,\n    \"affinity_cpus\": %d,\n"
+            "    \"cpu_quota\": %g,\n    \"memory\": %llu,\n    \"kernel\": ",
+            get_nprocs(), get_nprocs_conf(), plzo_cpu_count(NULL), plzo_cpu_quota(),
+            (unsigned long long) get_phys_pages() * sysconf(_SC_PAGESIZE));
+    put_string(out, host->release, false);
+    fprintf(out, ",\n    \"machine\": ");
+    put_string(out, host->machine, false);
+    fprintf(out, "\n  },\n  \"build\": {\n    \"compiler\": ");
+    put_string(out, PLZO_COMPILER, false);
+    fprintf(out, ",\n    \"cflags\": ");
+    put_string(out, PLZO_CFLAGS, false);
+#ifdef __OPTIMIZE__
+    fprintf(out, ",\n    \"optimized\": true");
+#else
+    fprintf(out, ",\n    \"optimized\": false");
+#endif
+    fprintf(out, ",\n    \"lzo\": ");
+    put_string(out, lzo_version_string(), false);
+    fprintf(out, "\n  },\n  \"settings\": {\n    \"threads\": %d,\n    \"block_size\": %lu,\n    \"repeat\": %d,\n"
+            "    \"max_runs\": %d,\n    \"warmup\": %d,\n    \"ci\": %g,\n"
+            "    \"min_block\": %lu,\n    \"max_block\": %lu,\n    \"perf\": %s,\n    \"workers\": %s,\n    \"numa\": %s,\n"
+            "    \"exec\": \"%s\",\n    \"pages\": \"%s\",\n    \"omp_schedule\": ",
+            report.options.threads, (unsigned long) report.options.block_size, report.options.repeat,
+            report.options.max_runs, report.options.warmup, report.options.ci,
+            (unsigned long) report.options.min_block, (unsigned long) report.options.max_block,
+            report.options.perf ? "true" : "false", report.options.workers ? "true" : "false",
+            report.options.numa ? "true" : "false",
+            plzo_exec_kind_name(report.options.exec), plzo_page_kind_name(plzo_pages()));
+    if (getenv("OMP_SCHEDULE") != NULL){
+        put_string(out, getenv("OMP_SCHEDULE"), false);
+    } else {
+        fprintf(out, "null");
+    }
+    fprintf(out, "\n  },\n  \"samples\": [");
+    for (c = 0; c < report.count; c++){
+        const struct bench_sample_s *e = &report.samples[c];
+        fprintf(out, "%s\n    {\"bench\": \"%s\", \"file\": ", c ? "," : "", e->bench);
+        put_string(out, e->file, false);
+        fprintf(out, ", \"engine\": \"%s\", \"op\": \"%s\", \"clock\": \"%s\", \"cache\": %s%s%s, \"threads\": %d, \"block_size\": %lu, "
+                "\"blocks\": %d, \"run\": %d, \"raw_bytes\": %llu, \"comp_bytes\": %llu, \"seconds\": %.9f, \"peak_rss\": %llu, "
+                "\"outlier\": %s, \"imbalance\": %.4f, \"schedule\": %s%s%s, \"pages\": \"%s\", \"counters\": ",
+                e->engine, e->op, e->clock, e->cache ? "\"" : "", e->cache ? e->cache : "null", e->cache ? "\"" : "",
+                e->threads, (unsigned long) e->block_size, e->blocks, e->run,
+                e->raw_bytes, e->comp_bytes, e->seconds, e->peak_rss, e->outlier ? "true" : "false", e->imbalance,
+                e->schedule ? "\"" : "", e->schedule ? e->schedule : "null", e->schedule ? "\"" : "", e->pages);
+        put_counters(out, &e->counters);
+        fputc('}', out);
+    }
+    fprintf(out, "\n  ],\n  \"worker_counters\": [");
+    for (c = 0; c < report.worker_count; c++){
+        const struct worker_counters_s *w = &report.workers[c];
+        fprintf(out, "%s\n    {\"bench\": \"%s\", \"file\": ", c ? "," : "", w->point.bench);
+        put_string(out, w->point.file, false);
+        fprintf(out, ", \"op\": \"%s\", \"cache\": %s%s%s, \"threads\": %d, \"block_size\": %lu, \"runs\": %d, "
+                "\"worker\": %d, \"counters\": ", w->point.op, w->point.cache ? "\"" : "",
+                w->point.cache ? w->point.cache : "null", w->point.cache ? "\"" : "", w->point.threads,
+                (unsigned long) w->point.block_size, w->point.run, w->worker);
+        put_counters(out, &w->counters);
+        fputc('}', out);
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+//one row per sample, the host and build columns repeat so every row stands on its own
+static void write_csv(FILE *out, const struct utsname *host, const char *model, const char *stamp){
+    int c, i;
+    fprintf(out, "schema,timestamp,host,cpu,online_cpus,kernel,compiler,cflags,lzo,bench,file,engine,op,clock,cache,"
+                 "threads,block_size,blocks,run,raw_bytes,comp_bytes,seconds,peak_rss,outlier,imbalance,schedule,pages,"
+                 "cycles,instructions,llc_misses,branch_misses,dtlb_misses\n");
+    for (c = 0; c < report.count; c++){
+        const struct bench_sample_s *e = &report.samples[c];
+        fprintf(out, "%s,%s,", BENCH_SCHEMA, stamp);
+        put_string(out, host->nodename, true);
+        fputc(',', out);
+        put_string(out, model, true);
+        fprintf(out, ",%d,", get_nprocs());
+        put_string(out, host->release, true);
+        fputc(',', out);
+        put_string(out, PLZO_COMPILER, true);
+        fputc(',', out);
+        put_string(out, PLZO_CFLAGS, true);
+        fputc(',', out);
+        put_string(out, lzo_version_string(), true);
+        fprintf(out, ",%s,", e->bench);
+        put_string(out, e->file, true);
+        fprintf(out, ",%s,%s,%s,%s,%d,%lu,%d,%d,%llu,%llu,%.9f,%llu,%d,%.4f,", e->engine, e->op, e->clock,
+                e->cache ? e->cache : "", e->threads,
+                (unsigned long) e->block_size, e->blocks, e->run, e->raw_bytes, e->comp_bytes, e->seconds, e->peak_rss,
+                e->outlier ? 1 : 0, e->imbalance);
+        put_string(out, e->schedule ? e->schedule : "", true);
+        fprintf(out, ",%s", e->pages);
+        for (i = 0; i < PERF_COUNTERS; i++){ // empty when not counted
+            if (e->counters.valid[i]){
+                fprintf(out, ",%llu", e->counters.value[i]);
+            } else {
+                fputc(',', out);
+            }
+        }
+        fputc('\n', out);
+    }
+}
+int bench_report_finish(void){
+    struct utsname host;
+    char model[256];
+    char stamp[32];
+    int status = LZO_E_OK;
+    if (!report.active){
+        return LZO_E_OK;
+    }
+    FILE *out = strcmp(report.path, "-") == 0 ? stdout : fopen(report.path, "w");
+    if (out == NULL){
+        printf("cannot create %s\n", report.path);
+        status = LZO_E_ERROR;
+    } else {
+        if (uname(&host) != 0){
+            memset(&host, 0, sizeof host);
+        }
+        cpu_model(model, sizeof model);
+        strftime(stamp, sizeof stamp, "%Y-%m-%dT%H:%M:%SZ", gmtime(&report.started));
+        if (report.csv){
+            write_csv(out, &host, model, stamp);
+        } else {
+            write_json(out, &host, model, stamp);
+        }
+        if (out != stdout && fclose(out) != 0){
+            status = LZO_E_ERROR;
+        }
+    }
+    free(report.samples);
+    free(report.workers);
+    free(report.command);
+    report.samples = NULL;
+    report.workers = NULL;
+    report.command = NULL;
+    report.count = 0;
+    report.size = 0;
+    report.worker_count = 0;
+    report.worker_size = 0;
+    report.active = false;
+    return status;
+}
@@ -0,0 +1,173 @@
+/* plzo_bench.h -- benchmarks of the block engine on any executor
+
+   Every benchmark loads its inputs once and times compression and
+   decompression from memory to memory with a monotonic wall clock, so
+   time spent by all workers together is not mistaken for elapsed time.
+ */
+
+#ifndef PLZO_BENCH_H
+#define PLZO_BENCH_H
+
+#include <lzo/lzoconf.h>
+#include <stdbool.h>
+#include "plzo.h"
+
+struct bench_options_s {
+    int threads; // most threads used, 0 for plzo_cpu_threads(cpus)
+    lzo_uint block_size; // largest block, smaller when a file has fewer blocks than threads
+    int repeat; // least timed runs per point, 0 for 5
+    int max_runs; // runs stop here even if the confidence interval is still wider than ci
+    int warmup; // untimed runs before each point
+    double ci; // wanted half width of the 95% confidence interval relative to the mean, 0 for 2%
+    lzo_uint min_block; // block size sweep range, 0 for 16K and 64M
+    lzo_uint max_block;
+    unsigned long long seed; // synthetic inputs, CORPUS_SEED unless --seed is given
+    bool perf; // count hardware events of every worker during the timed runs
+    bool workers; // print busy, cpu and idle time of every worker below each point
+    int exec; // executor of every run, PLZO_EXEC_POOL unless --exec is given
+    bool numa; // workers bound per NUMA node, every buffer first touched on the node that processes it
+    const char *cpus; // cpu list the workers are pinned to, NULL for the whole affinity mask
+};
+
+//an executor with the placement of opt, NULL with a message when the kind is not built in
+plzo_exec *bench_exec(const struct bench_options_s *opt, int kind, int threads);
+
+/* Hardware counters: with --perf every timed run is also counted with
+   perf_event_open on each worker thread, user space only. Counters the CPU
+   does not offer are left out; when none can be opened (perf_event_paranoid
+   above 2, a VM without a PMU) the benchmarks run without them. */
+
+#define PERF_CYCLES        0
+#define PERF_INSTRUCTIONS  1
+#define PERF_LLC_MISSES    2 // last level cache read misses, or generic cache misses
+#define PERF_BRANCH_MISSES 3
+#define PERF_DTLB_MISSES   4 // data TLB read misses
+#define PERF_COUNTERS      5
+
+struct bench_counters_s {
+    unsigned long long value[PERF_COUNTERS];
+    bool valid[PERF_COUNTERS];
+};
+typedef struct bench_perf_s bench_perf;
+
+//report names of the counters: cycles, instructions, llc_misses, branch_misses, dtlb_misses
+extern const char *perf_names[PERF_COUNTERS];
+//opens the counters of every thread of the executor, NULL with a message when none are available
+bench_perf *perf_open(const plzo_exec *exec);
+void perf_start(bench_perf *perf);
+//stops counting and stores what each worker counted since perf_start
+void perf_stop(bench_perf *perf, struct bench_counters_s *workers);
+void perf_close(bench_perf *perf);
+
+//timings of one benchmark point in seconds, the median is what the tables report
+struct bench_stats_s {
+    int runs;
+    double min;
+    double median;
+    double p95;
+    double mean;
+    double stddev;
+    double mad; // median absolute deviation, the scale of the outlier test
+    double ci; // relative half width of the 95% confidence interval of the mean without outliers
+    int outliers;
+    double imbalance; // busy time of the slowest worker over the mean over all runs, 1 when balanced
+};
+
+/* Reports: with --format json or csv every timed run is kept as a raw
+   sample and written out at the end together with the host, the build and
+   the settings of the run. The layout is described by
+   plzo_bench.schema.json; "plzo-bench/1" in the schema field identifies it. */
+
+#define BENCH_SCHEMA "plzo-bench/1"
+
+//one timed run, raw_bytes and comp_bytes are the uncompressed and compressed size whatever the direction
+struct bench_sample_s {
+    const char *bench; // scale, blocks, mem, sched, pages or calgary
+    const char *file;
+    const char *engine; // pool, openmp or serial
+    const char *op; // compress or decompress
+    const char *clock; // wall, or process-cpu for the clock() timings of the calgary driver
+    const char *cache; // hot, cold when input and output were flushed from every cache before the run, NULL if unknown
+    int threads;
+    lzo_uint block_size;
+    int blocks;
+    int run;
+    unsigned long long raw_bytes;
+    unsigned long long comp_bytes;
+    double seconds;
+    unsigned long long peak_rss; // bytes, 0 when not measured
+    bool outlier; // modified z-score above 3.5 within its point
+    struct bench_counters_s counters; // sum over the workers, nothing valid without --perf
+    double imbalance; // busy time of the slowest worker over the mean, 0 when not measured
+    const char *schedule; // OpenMP schedule of a sched point, NULL for the pool and every other benchmark
+    const char *pages; // page kind asked for the buffers, small, thp or hugetlb
+};
+
+//starts collecting samples, format is json or csv, path NULL means results_bench.json or .csv and "-" stdout
+int bench_report_start(const char *format, const char *path, const struct bench_options_s *opt, int argc, char **argv);
+//records a sample, does nothing unless a report was started
+void bench_report_add(const struct bench_sample_s *sample);
+//writes the report and frees the samples
+int bench_report_finish(void);
+
+//compresses and decompresses every file with 1, 2, 4 ... threads and reports speedup, efficiency
+//and the serial fraction estimated from the sweep
+int bench_scale(const struct bench_options_s *opt, char **names, int count);
+
+//times compression and decompression of every file with warm caches and again with the input and
+//output buffers flushed from every cache level before each run, and reports GB/s per core
+int bench_mem(const struct bench_options_s *opt, char **names, int count);
+
+//compresses and decompresses every file with block sizes doubling from min_block to max_block at a
+//fixed thread count and reports ratio, throughput and the peak resident set of each point
+int bench_blocks(const struct bench_options_s *opt, char **names, int count);
+
+//times every file cut into at least 8 blocks per thread on an OpenMP team under the static, static,1,
+//dynamic,1, dynamic,4 and guided schedules and on the pool, whatever opt->exec is
+int bench_sched(const struct bench_options_s *opt, char **names, int count);
+
+//times every file with its buffers in small pages, then in transparent huge pages and in hugetlb pages, and
+//reports the throughput of each against small pages and the page kind the buffers actually got
+int bench_pages(const struct bench_options_s *opt, char **names, int count);
+
+/* Calgary driver: what both programs ran before the benchmarks above.
+   Every file of the Calgary Corpus and big1, big4, book3 and html in the
+   current directory is compressed and decompressed ten times whole with
+   lzo1x and ten times cut into fixed size blocks on the executor, timed
+   with clock(); the means go to results_<pthread|omp|serial>_actual_<N>_threads.txt. */
+
+#define CALGARY_FILES 22
+#define CALGARY_BLOCK_SIZE (64 * 1024) // unless -b is given, many blocks per thread even for the small files
+extern char *calgary_files[CALGARY_FILES];
+//block_size 0 cuts every file into one block per thread
+int bench_calgary(plzo_exec *exec, lzo_uint block_size);
+//extension of a file name from its last dot, "" when there is none
+const char *getExt(const char *fspec);
+
+/* Synthetic corpus: deterministic data of any size without downloading a
+   dataset. The output is cut into CORPUS_SEGMENT byte segments, each with
+   its own generator seeded from the seed, the kind and the segment number,
+   so the same seed always gives the same bytes and any range of a 100 GB
+   input can be produced without generating what comes before it.
+   Benchmarks accept "@kind:size" (e.g. @text:64M) wherever a file name
+   goes. */
+
+#define CORPUS_TEXT   0 // words with a skewed frequency, punctuation and lines
+#define CORPUS_BINARY 1 // fixed size records with counters and small fields
+#define CORPUS_RANDOM 2 // incompressible
+#define CORPUS_ZERO   3 // long zero runs with short random bursts
+#define CORPUS_MIXED  4 // the other kinds alternating every quarter segment
+#define CORPUS_KINDS  5
+#define CORPUS_SEED 0x504c5a4fULL
+#define CORPUS_SEGMENT (64 * 1024)
+
+//kind number of text, binary, random, zero or mixed, -1 for anything else
+int corpus_kind(const char *name);
+//fills out with len bytes of the stream starting at offset
+void corpus_fill(int kind, unsigned long long seed, unsigned long long offset, lzo_bytep out, lzo_uint len);
+//writes size bytes to path, NULL or "-" for stdout, in bounded memory
+int corpus_write(int kind, unsigned long long seed, unsigned long long size, const char *path);
+//parses sizes such as 65536, 64K, 16M or 100G
+unsigned long long bench_parse_size(const char *arg);
+
+#endif
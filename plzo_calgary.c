@@ -0,0 +1,455 @@
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+#include "plzo_bench.h"
+static lzo_voidp wrkmem;
+
+char *calgary_files[CALGARY_FILES] = {"trans","paper4","paper3","news","paper2","book1","geo","obj2","paper1","progp","paper5","pic","paper6","progc","progl","bib","obj1","book2", "big1", "big4", "book3", "html"};
+//struct to hold the results
+struct result_s {
+    lzo_uint in_size;
+    lzo_uint out_size;
+    double ratio;
+    double time;
+    double imbalance; // max over mean busy time of the workers, 0 for serial runs
+    int blocks;
+};
+const char *getExt (const char *fspec) {
+    char *e = strrchr (fspec, '.');
+    if (e == NULL)
+        e = "";
+    return e;
+}
+//cuts the file into block_size blocks, one block per thread when block_size is 0, so the executor has
+//more blocks than threads to balance
+static struct result_s compress_data_parallel(plzo_exec *exec, char filename[], lzo_uint block_size){
+    struct result_s result;
+    clock_t start;
+    int c;
+    int thread_count = plzo_exec_threads(exec);
+    FILE *infile = fopen(filename, "rb");
+    char *ext = (char *) getExt(filename);
+    char *outfilename;
+    int cmp = strcmp(ext, "");
+    if (cmp == 0){
+        outfilename = (char *) xmalloc(strlen(filename) + 6);
+        strcpy(outfilename, filename);
+        strcat(outfilename, ".plzo");
+    } else if (cmp > 0){
+        outfilename = (char *) xmalloc(strlen(filename) + 5); // an extension shorter than .plzo grows the name
+        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
+        outfilename[strlen(filename) - strlen(ext)] = '\0';
+        strcat(outfilename, "plzo");
+    }
+    FILE *outfile = fopen(outfilename, "wb");
+    fseek(infile, 0, SEEK_END);
+    lzo_uint in_len = ftell(infile);
+    rewind(infile);
+    lzo_uint data_c_size = block_size ? block_size : (in_len + thread_count - 1) / thread_count;
+    int block_count = data_c_size ? (int) ((in_len + data_c_size - 1) / data_c_size) : 0;
+    if (block_count == 0){ // an empty file is still one empty block
+        block_count = 1;
+    }
+    //recycled from the previous run of the same file, the 10 runs allocate and fault the buffers once
+    lzo_bytep data = (lzo_bytep) plzo_buffer_get(in_len + 1);
+    in_len = fread(data, 1, in_len, infile);
+    struct plzo_block_s *args = (struct plzo_block_s *) xmalloc(sizeof(struct plzo_block_s) * block_count);
+    for (c = 0; c < block_count; c++){
+        args[c].data = data + c * data_c_size;
+        args[c].data_size = c == block_count - 1 ? in_len - c * data_c_size : data_c_size;
+    }
+    lzo_uint arena_size = plzo_batch_bound(PLZO_COMPRESS, args, block_count);
+    lzo_bytep arena = (lzo_bytep) plzo_buffer_get(arena_size + 1);
+    plzo_exec_stats_reset(exec);
+    start = clock();
+    int r = plzo_exec_batch(exec, PLZO_COMPRESS | PLZO_CHECKSUM, args, block_count, arena, arena_size);
+    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    result.imbalance = plzo_exec_imbalance(exec);
+    result.blocks = block_count;
+    if (r != LZO_E_OK){
+        printf("parallel comp error %d\n", r);
+    }
+    plzo_file_write(outfile, filename, args, block_count);
+    free(args);
+    plzo_buffer_put(arena);
+    plzo_buffer_put(data);
+    result.in_size = in_len;
+    result.out_size = ftell(outfile);
+    result.ratio = (double) result.out_size / result.in_size;
+    fclose(outfile);
+    fclose(infile);
+    free(outfilename);
+    return result;
+}
+static struct result_s decompress_data_parallel(plzo_exec *exec, char filename[]){
+    struct result_s result;
+    clock_t start;
+    struct plzo_block_s *args;
+    plzo_archive *archive = plzo_archive_open(filename);
+    char *ext = (char *) getExt(filename);
+    char outfilename[strlen(filename) + 4];
+    strncpy(outfilename, filename, strlen(filename) - strlen(ext));
+    outfilename[strlen(filename) - strlen(ext)] = '\0';
+    strcat(outfilename, "_dp");
+    FILE *outfile = fopen(outfilename, "wb");
+    result.in_size = 0;
+    result.out_size = 0;
+    result.ratio = 0;
+    result.time = 0;
+    result.imbalance = 0;
+    result.blocks = 0;
+    if (archive == NULL || plzo_archive_count(archive) < 1){
+        printf("%s is not a plzo file\n", filename);
+        if (archive != NULL){
+            plzo_archive_close(archive);
+        }
+        fclose(outfile);
+        return result;
+    }
+    const struct plzo_entry_s *e = plzo_archive_entry(archive, 0);
+    lzo_bytep data = plzo_archive_load(archive, 0, &args);
+    if (data == NULL){
+        printf("%s is corrupt\n", filename);
+        e = NULL;
+    }
+    lzo_bytep out = (lzo_bytep) plzo_buffer_get(e != NULL ? e->size + 1 : 1);
+    int r = LZO_E_ERROR;
+    plzo_exec_stats_reset(exec);
+    start = clock();
+    if (e != NULL){
+        r = plzo_exec_batch(exec, PLZO_DECOMPRESS | PLZO_CHECKSUM, args, e->block_count, out, e->size);
+    }
+    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    result.imbalance = plzo_exec_imbalance(exec);
+    result.blocks = e != NULL ? (int) e->block_count : 0;
+    if (e != NULL && r != LZO_E_OK){
+        printf("parallel decomp error %d\n", r);
+    }
+    if (r == LZO_E_OK){
+        fwrite(out, 1, e->size, outfile);
+    }
+    plzo_buffer_put(data);
+    free(args);
+    plzo_buffer_put(out);
+    plzo_archive_close(archive);
+    struct stat st;
+    if (stat(filename, &st) == 0){
+        result.in_size = st.st_size;
+    }
+    result.out_size = ftell(outfile);
+    result.ratio = (double) result.out_size / result.in_size;
+    fclose(outfile);
+    return result;
+}
+static struct result_s compress_data_serial(char filename[]){
+    struct result_s result;
+    clock_t start;
+    wrkmem = (lzo_voidp) xmalloc(LZO1X_1_MEM_COMPRESS);
+    FILE *infile = fopen(filename, "rb");
+    fseek(infile, 0, SEEK_END);
+    lzo_uint in_len = ftell(infile);
+    rewind(infile);
+    lzo_bytep data = (lzo_bytep) xmalloc(in_len);
+    fread(data, 1, in_len, infile);
+    fclose(infile);
+    lzo_uint out_len = in_len + in_len / 16 + 64 + 3;
+    lzo_bytep out = (lzo_bytep) xmalloc(out_len);
+    start = clock();
+    int r = lzo1x_1_compress(data, in_len, out, &out_len, wrkmem);
+    if (r != LZO_E_OK){
+        printf("serial comp error %d\n", r);
+    }
+    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    result.imbalance = 0;
+    result.blocks = 1;
+    char outfilename[strlen(filename) + 4];
+    char *ext = (char *) getExt(filename);
+    int cmp = strcmp(ext, "");
+    if (cmp == 0){
+        strcpy(outfilename, filename);
+        strcat(outfilename, ".lzo");
+    } else if (cmp > 0){
+        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
+        outfilename[strlen(filename) - strlen(ext)] = '\0';
+        strcat(outfilename, "lzo");
+    }
+    FILE *outfile = fopen(outfilename, "wb");
+    fwrite(out, 1, out_len, outfile);
+    fclose(outfile);
+    free(data);
+    free(out);
+    result.in_size = in_len;
+    result.out_size = out_len;
+    result.ratio = (double) result.out_size / result.in_size;
+    free(wrkmem);
+    return result;
+}
+static struct result_s decompress_data_serial(char filename[]){
+    struct result_s result;
+    clock_t start;
+    FILE *infile = fopen(filename, "rb");
+    fseek(infile, 0, SEEK_END);
+    lzo_uint in_len = ftell(infile);
+    rewind(infile);
+    lzo_bytep data = (lzo_bytep) malloc(in_len);
+    fread(data, 1, in_len, infile);
+    fclose(infile);
+    lzo_uint out_len = in_len * 16;
+    lzo_bytep out = (lzo_bytep) malloc(out_len);
+    start = clock();
+    int r = lzo1x_decompress(data, in_len, out, &out_len, NULL);
+    result.time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    result.imbalance = 0;
+    result.blocks = 1;
+    if (r != LZO_E_OK){
+        printf("serial decomp error %d\n", r);
+    }
+    char outfilename[strlen(filename) + 4];
+    char *ext = (char *) getExt(filename);
+    int cmp = strcmp(ext, "");
+    if (cmp == 0){
+        strcpy(outfilename, filename);
+        strcat(outfilename, "_ds");
+    } else if (cmp > 0) {
+        strncpy(outfilename, filename, strlen(filename) - strlen(ext));
+        outfilename[strlen(filename) - strlen(ext)] = '\0';
+        strcat(outfilename, "_ds");
+    }
+    FILE *outfile = fopen(outfilename, "wb");
+    fwrite(out, 1, out_len, outfile);
+    fclose(outfile);
+    free(data);
+    free(out);
+    result.in_size = in_len;
+    result.out_size = out_len;
+    result.ratio = (double) result.out_size / result.in_size;
+    return result;
+}
+static bool test_file_integrity(char filename[]){
+    FILE *original_file = fopen(filename, "rb");
+    char *decompressed_filename = (char *) xmalloc(strlen(filename) + 4);
+    strcpy(decompressed_filename, filename);
+    strcat(decompressed_filename, "_dp");
+    FILE *decompressed_file = fopen(decompressed_filename, "rb");
+    fseek(original_file, 0, SEEK_END);
+    long int original_size = ftell(original_file);
+    fseek(decompressed_file, 0, SEEK_END);
+    long int decompressed_size = ftell(decompressed_file);
+    if (original_size != decompressed_size){
+        printf("file sizes do not match - %s and %s\n", filename, decompressed_filename);
+        return false;
+    }
+    rewind(original_file);
+    rewind(decompressed_file);
+    // compare byte by byte
+    char original_byte;
+    char decompressed_byte;
+    while (fread(&original_byte, 1, 1, original_file) == 1){
+        fread(&decompressed_byte, 1, 1, decompressed_file);
+        if (original_byte != decompressed_byte){
+            printf("file contents do not match - %s and %s\n", filename, decompressed_filename);
+            return false;
+        }
+    }
+    fclose(original_file);
+    fclose(decompressed_file);
+    return true;
+}
+//adds one run of the calgary driver to the benchmark report, its timings are process cpu time
+static void report_result(const char *engine, const char *op, const char *file, int threads, lzo_uint block_size,
+                          int run, const struct result_s *result){
+    struct bench_sample_s sample;
+    bool comp = strcmp(op, "compress") == 0;
+    memset(&sample, 0, sizeof sample);
+    sample.bench = "calgary";
+    sample.file = file;
+    sample.engine = engine;
+    sample.pages = plzo_page_kind_name(plzo_pages());
+    sample.op = op;
+    sample.clock = "process-cpu";
+    sample.threads = threads;
+    sample.block_size = block_size;
+    sample.blocks = result->blocks;
+    sample.run = run;
+    sample.raw_bytes = comp ? result->in_size : result->out_size;
+    sample.comp_bytes = comp ? result->out_size : result->in_size;
+    sample.seconds = result->time;
+    sample.imbalance = result->imbalance;
+    bench_report_add(&sample);
+}
+//the driver both programs started from, results_<name>_actual_<threads>_threads.txt is named after the executor
+int bench_calgary(plzo_exec *exec, lzo_uint block_size){
+    static const char *result_names[PLZO_EXEC_KINDS] = {"pthread", "omp", "serial"};
+    int thread_count = plzo_exec_threads(exec);
+    printf("Parallel LZO compression & decompression test using Calgary Corpus and some other big files\n");
+    char **filenames = calgary_files;
+    struct result_s results_s[CALGARY_FILES][2]; // 0 for compression, 1 for decompression
+    struct result_s results_p[CALGARY_FILES][2]; // 0 for compression, 1 for decompression
+    for (int tempcount = 0; tempcount < CALGARY_FILES; tempcount++){
+        results_s[tempcount][0].in_size = 0;
+        results_s[tempcount][0].out_size = 0;
+        results_s[tempcount][0].ratio = 0;
+        results_s[tempcount][0].time = 0;
+        results_s[tempcount][1].in_size = 0;
+        results_s[tempcount][1].out_size = 0;
+        results_s[tempcount][1].ratio = 0;
+        results_s[tempcount][1].time = 0;
+        results_p[tempcount][0].in_size = 0;
+        results_p[tempcount][0].out_size = 0;
+        results_p[tempcount][0].ratio = 0;
+        results_p[tempcount][0].time = 0;
+        results_p[tempcount][1].in_size = 0;
+        results_p[tempcount][1].out_size = 0;
+        results_p[tempcount][1].ratio = 0;
+        results_p[tempcount][1].time = 0;
+    }
+    int j;
+    double sumtime = 0;
+    double sumratio = 0;
+    double sumimbalance = 0;
+    for (j = 0; j < CALGARY_FILES; j++) { // for each file in the corpus do the following
+        sumtime = 0;
+        sumratio = 0;
+        sumimbalance = 0;
+        char *temp;
+        printf("file is %s\n", filenames[j]);
+        for (int i = 0; i < 10; i++){
+            results_s[j][0] = compress_data_serial(filenames[j]); // compress the file using serial compression
+            report_result("serial", "compress", filenames[j], 1, 0, i, &results_s[j][0]);
+            sumtime += results_s[j][0].time;
+            sumratio += results_s[j][0].ratio;
+        }
+        results_s[j][0].time = sumtime / 10;
+        results_s[j][0].ratio = sumratio / 10;
+        sumratio = 0;
+        sumtime = 0;
+        printf("s comp %d done\n", j);
+        temp = (char *) xmalloc(strlen(filenames[j]) + 4);
+        strcpy(temp, filenames[j]);
+        strcat(temp, ".lzo");
+        for (int i = 0; i < 10; i++){
+            results_s[j][1] = decompress_data_serial(temp); // decompress the file using serial decompression
+            report_result("serial", "decompress", filenames[j], 1, 0, i, &results_s[j][1]);
+            sumtime += results_s[j][1].time;
+            sumratio += results_s[j][1].ratio;
+        }
+        results_s[j][1].time = sumtime / 10;
+        results_s[j][1].ratio = sumratio / 10;
+        sumratio = 0;
+        sumtime = 0;
+        printf("s decomp %d done\n", j);
+        free(temp);
+        for (int i = 0; i < 10; i++){
+            results_p[j][0] = compress_data_parallel(exec, filenames[j], block_size); // compress the file using parallel compression
+            report_result(plzo_exec_name(exec), "compress", filenames[j], thread_count, block_size, i, &results_p[j][0]);
+            sumtime += results_p[j][0].time;
+            sumratio += results_p[j][0].ratio;
+            sumimbalance += results_p[j][0].imbalance;
+        }
+        results_p[j][0].time = sumtime / 10;
+        results_p[j][0].ratio = sumratio / 10;
+        results_p[j][0].imbalance = sumimbalance / 10;
+        sumratio = 0;
+        sumtime = 0;
+        sumimbalance = 0;
+        printf("p comp %d done, imbalance %.3f\n", j, results_p[j][0].imbalance);
+        temp = (char *) xmalloc(strlen(filenames[j]) + 5);
+        strcpy(temp, filenames[j]);
+        strcat(temp, ".plzo");
+        for (int i = 0; i < 10; i++){
+            results_p[j][1] = decompress_data_parallel(exec, temp); // decompress the file using parallel decompression
+            report_result(plzo_exec_name(exec), "decompress", filenames[j], thread_count, block_size, i, &results_p[j][1]);
+            sumtime += results_p[j][1].time;
+            sumratio += results_p[j][1].ratio;
+            sumimbalance += results_p[j][1].imbalance;
+        }
+        results_p[j][1].time = sumtime / 10;
+        results_p[j][1].ratio = sumratio / 10;
+        results_p[j][1].imbalance = sumimbalance / 10;
+        printf("p decomp %d done, imbalance %.3f\n", j, results_p[j][1].imbalance);
+        free(temp);
+        if (test_file_integrity(filenames[j]) == false){
+            printf("file integrity test failed at file %d - %s\n", j, filenames[j]);
+        }
+    }
+    char results_filename[100];
+    snprintf(results_filename, sizeof results_filename, "results_%s_actual_%d_threads.txt",
+             result_names[plzo_exec_kind(plzo_exec_name(exec))], thread_count);
+    FILE *results_file = fopen(results_filename, "wb");
+    fprintf(results_file, "%-30s\t%15s\t%15s\t%15s\t%15s\t%15s\t%15s\t%15s\n\n", "filename", "file-size", "comp-size", "comp-ratio", "comp-time", "decomp-size", "decomp-ratio", "decomp-time");
+    for (j = 0; j < CALGARY_FILES; j++){
+        fprintf(results_file, "%-30s\n", filenames[j]);
+        fprintf(results_file, "%30s\t", "serial");
+        char file_size[20];
+        sprintf(file_size, "%15.4lu", results_s[j][0].in_size);
+        fwrite(file_size, 1, strlen(file_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char comp_size[20];
+        sprintf(comp_size, "%15.4lu", results_s[j][0].out_size);
+        fwrite(comp_size, 1, strlen(comp_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char comp_ratio[20];
+        sprintf(comp_ratio, "%15.8f", results_s[j][0].ratio);
+        fwrite(comp_ratio, 1, strlen(comp_ratio), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char comp_time[20];
+        sprintf(comp_time, "%15.8f", results_s[j][0].time);
+        fwrite(comp_time, 1, strlen(comp_time), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char decomp_size[20];
+        sprintf(decomp_size, "%15.4lu", results_s[j][1].out_size);
+        fwrite(decomp_size, 1, strlen(decomp_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char decomp_ratio[20];
+        sprintf(decomp_ratio, "%15.8f", results_s[j][1].ratio);
+        fwrite(decomp_ratio, 1, strlen(decomp_ratio), results_file);
+        fwrite("\t", 1, 1, results_file);
+        char decomp_time[20];
+        sprintf(decomp_time, "%15.8f", results_s[j][1].time);
+        fwrite(decomp_time, 1, strlen(decomp_time), results_file);
+        fwrite("\n", 1, 1, results_file);
+        fprintf(results_file, "%30s\t", "parallel");
+        sprintf(file_size, "%15.4lu", results_p[j][0].in_size);
+        fwrite(file_size, 1, strlen(file_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(comp_size, "%15.4lu", results_p[j][0].out_size);
+        fwrite(comp_size, 1, strlen(comp_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(comp_ratio, "%15.8f", results_p[j][0].ratio);
+        fwrite(comp_ratio, 1, strlen(comp_ratio), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(comp_time, "%15.8f", results_p[j][0].time);
+        fwrite(comp_time, 1, strlen(comp_time), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(decomp_size, "%15.4lu", results_p[j][1].out_size);
+        fwrite(decomp_size, 1, strlen(decomp_size), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(decomp_ratio, "%15.8f", results_p[j][1].ratio);
+        fwrite(decomp_ratio, 1, strlen(decomp_ratio), results_file);
+        fwrite("\t", 1, 1, results_file);
+        sprintf(decomp_time, "%15.8f", results_p[j][1].time);
+        fwrite(decomp_time, 1, strlen(decomp_time), results_file);
+        fwrite("\n\n", 2, 1, results_file);
+    }
+    fprintf(results_file, "%-15s%15d\n", "thread-count:", (int) thread_count);
+    fprintf(results_file, "%-15s%15lu\n", "block-size:", (unsigned long) block_size);
+    fclose(results_file);
+    struct plzo_buffer_stats_s buffers;
+    plzo_buffer_stats(&buffers);
+    printf("buffers: %llu taken, %llu allocated\n", buffers.gets, buffers.allocs);
+    plzo_buffer_trim();
+    printf("done\n");
+    return LZO_E_OK;
+}
@@ -0,0 +1,213 @@
+#include <lzo/lzoconf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+#include "plzo_bench.h"
+
+#define VOCABULARY 2048
+#define WRITE_CHUNK (1024 * 1024)
+
+static const char *kind_names[CORPUS_KINDS] = {"text", "binary", "random", "zero", "mixed"};
+
+//same generator as lzo_rand64_r32 in lzo_supp.h
+struct corpus_rand_s {
+    unsigned long long seed;
+};
+static lzo_uint32_t next_rand(struct corpus_rand_s *r){
+    r->seed = r->seed * 6364136223846793005ULL + 1;
+    return (lzo_uint32_t) (r->seed >> 32);
+}
+//every segment has its own generator, so any offset can be produced without the data before it
+static void segment_rand(struct corpus_rand_s *r, unsigned long long seed, int kind, unsigned long long segment){
+    int c;
+    r->seed = seed ^ (segment + 1) * 0x9e3779b97f4a7c15ULL ^ (unsigned long long) (kind + 1) << 56;
+    for (c = 0; c < 4; c++){ // let nearby seeds drift apart
+        next_rand(r);
+    }
+}
+
+//word list shared by every text segment, rebuilt when the seed changes
+static char vocabulary[VOCABULARY][12];
+static unsigned long long vocabulary_seed;
+static bool vocabulary_ready = false;
+
+static void build_vocabulary(unsigned long long seed){
+    //letters by english frequency, squaring a uniform index favours the common ones
+    static const char letters[] = "etaoinshrdlcumwfgypbvkjxqz";
+    struct corpus_rand_s r;
+    int c, i;
+    if (vocabulary_ready && vocabulary_seed == seed){
+        return;
+    }
+    r.seed = seed;
+    for (c = 0; c < VOCABULARY; c++){
+        int len = 1 + next_rand(&r) % 4 + next_rand(&r) % 6;
+        for (i = 0; i < len; i++){
+            lzo_uint32_t x = next_rand(&r) % 26;
+            vocabulary[c][i] = letters[x * x / 26];
+        }
+        vocabulary[c][len] = '\0';
+    }
+    vocabulary_seed = seed;
+    vocabulary_ready = true;
+}
+//words picked with a skew towards the start of the vocabulary, with punctuation and short lines
+static void fill_text(struct corpus_rand_s *r, lzo_bytep out, lzo_uint len){
+    lzo_uint pos = 0;
+    int line = 0;
+    bool capital = true;
+    while (pos < len){
+        lzo_uint32_t x = next_rand(r) % VOCABULARY;
+        const char *word = vocabulary[x * x / VOCABULARY];
+        lzo_uint32_t p = next_rand(r) % 100;
+        for (; *word != '\0' && pos < len; word++, line++){
+            out[pos++] = capital ? *word - 'a' + 'A' : *word;
+            capital = false;
+        }
+        if (p < 6 && pos < len){
+            out[pos++] = '.';
+            capital = true;
+        } else if (p < 14 && pos < len){
+            out[pos++] = ',';
+        }
+        if (pos < len){
+            out[pos++] = line > 64 ? '\n' : ' ';
+            line = line > 64 ? 0 : line + 1;
+        }
+    }
+}
+//16 byte records: sequence number, timestamp with small steps, one of a few types, rare flags, small value
+static void fill_binary(struct corpus_rand_s *r, lzo_bytep out, lzo_uint len, unsigned long long segment){
+    unsigned char record[16];
+    lzo_uint32_t sequence = (lzo_uint32_t) (segment * (CORPUS_SEGMENT / 16));
+    lzo_uint32_t stamp = (lzo_uint32_t) (segment * 1000003);
+    lzo_uint pos = 0;
+    while (pos < len){
+        lzo_uint32_t x = next_rand(r);
+        lzo_uint n = len - pos < 16 ? len - pos : 16;
+        stamp += x % 97;
+        plzo_put_le32(record, sequence++);
+        plzo_put_le32(record + 4, stamp);
+        record[8] = (unsigned char) (x >> 8) % 8;
+        record[9] = 0;
+        record[10] = (x >> 16) % 64 == 0 ? (unsigned char) (x >> 24) : 0;
+        record[11] = 0;
+        plzo_put_le32(record + 12, next_rand(r) % 1024);
+        memcpy(out + pos, record, n);
+        pos += n;
+    }
+}
+static void fill_random(struct corpus_rand_s *r, lzo_bytep out, lzo_uint len){
+    lzo_uint pos = 0;
+    while (pos + 4 <= len){
+        plzo_put_le32(out + pos, next_rand(r));
+        pos += 4;
+    }
+    for (; pos < len; pos++){
+        out[pos] = (unsigned char) next_rand(r);
+    }
+}
+//long runs of zeros broken by short random bursts, like sparse files or padded tables
+static void fill_zero(struct corpus_rand_s *r, lzo_bytep out, lzo_uint len){
+    lzo_uint pos = 0;
+    while (pos < len){
+        lzo_uint zeros = 512 + next_rand(r) % 16384;
+        lzo_uint burst = 1 + next_rand(r) % 64;
+        zeros = zeros < len - pos ? zeros : len - pos;
+        memset(out + pos, 0, zeros);
+        pos += zeros;
+        burst = burst < len - pos ? burst : len - pos;
+        fill_random(r, out + pos, burst);
+        pos += burst;
+    }
+}
+static void fill_segment(int kind, struct corpus_rand_s *r, lzo_bytep out, lzo_uint len, unsigned long long segment){
+    lzo_uint part = CORPUS_SEGMENT / 4;
+    lzo_uint pos;
+    switch (kind){
+    case CORPUS_TEXT:
+        fill_text(r, out, len);
+        break;
+    case CORPUS_BINARY:
+        fill_binary(r, out, len, segment);
+        break;
+    case CORPUS_RANDOM:
+        fill_random(r, out, len);
+        break;
+    case CORPUS_ZERO:
+        fill_zero(r, out, len);
+        break;
+    default: // quarters of a segment take turns between the other kinds, so entropy changes within blocks
+        for (pos = 0; pos < len; pos += part){
+            fill_segment(next_rand(r) % CORPUS_MIXED, r, out + pos, len - pos < part ? len - pos : part, segment);
+        }
+        break;
+    }
+}
+int corpus_kind(const char *name){
+    int c;
+    for (c = 0; c < CORPUS_KINDS; c++){
+        if (strcmp(name, kind_names[c]) == 0){
+            return c;
+        }
+    }
+    return -1;
+}
+void corpus_fill(int kind, unsigned long long seed, unsigned long long offset, lzo_bytep out, lzo_uint len){
+    lzo_bytep segment_buf = NULL;
+    lzo_uint pos = 0;
+    build_vocabulary(seed);
+    while (pos < len){
+        unsigned long long segment = (offset + pos) / CORPUS_SEGMENT;
+        lzo_uint skip = (offset + pos) % CORPUS_SEGMENT;
+        lzo_uint n = CORPUS_SEGMENT - skip < len - pos ? CORPUS_SEGMENT - skip : len - pos;
+        struct corpus_rand_s r;
+        segment_rand(&r, seed, kind, segment);
+        if (n == CORPUS_SEGMENT){ // whole segment, generate in place
+            fill_segment(kind, &r, out + pos, n, segment);
+        } else {
+            if (segment_buf == NULL){
+                segment_buf = (lzo_bytep) xmalloc(CORPUS_SEGMENT);
+            }
+            fill_segment(kind, &r, segment_buf, CORPUS_SEGMENT, segment);
+            memcpy(out + pos, segment_buf + skip, n);
+        }
+        pos += n;
+    }
+    free(segment_buf);
+}
+int corpus_write(int kind, unsigned long long seed, unsigned long long size, const char *path){
+    unsigned long long offset = 0;
+    int status = LZO_E_OK;
+    FILE *out = path == NULL || strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (out == NULL){
+        printf("cannot create %s\n", path);
+        return LZO_E_ERROR;
+    }
+    lzo_bytep buf = (lzo_bytep) xmalloc(WRITE_CHUNK);
+    while (offset < size){
+        lzo_uint n = size - offset < WRITE_CHUNK ? size - offset : WRITE_CHUNK;
+        corpus_fill(kind, seed, offset, buf, n);
+        if (fwrite(buf, 1, n, out) != n){
+            status = LZO_E_ERROR;
+            break;
+        }
+        offset += n;
+    }
+    free(buf);
+    if (out != stdout && fclose(out) != 0){
+        status = LZO_E_ERROR;
+    }
+    if (status != LZO_E_OK){
+        fprintf(stderr, "write error - %s\n", path != NULL ? path : "stdout");
+    }
+    return status;
+}
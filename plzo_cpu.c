@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <lzo/lzoconf.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "plzo.h"
+
+#define MAX_NODES 64
+
+//nodes that have cpus the process may use and the affinity mask itself, read once
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static cpu_set_t process_cpus;
+static int node_count = 0;
+static int node_ids[MAX_NODES];
+static cpu_set_t node_cpus[MAX_NODES];
+
+//parses a kernel cpu or node list such as 0-3,8,10-11, false on anything else
+static bool parse_list(const char *list, cpu_set_t *set){
+    const char *p = list;
+    CPU_ZERO(set);
+    while (*p != '\0' && *p != '\n'){
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0){
+            return false;
+        }
+        p = end;
+        if (*p == '-'){
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first){
+                return false;
+            }
+            p = end;
+        }
+        if (last >= CPU_SETSIZE){
+            return false;
+        }
+        for (; first <= last; first++){
+            CPU_SET(first, set);
+        }
+        if (*p == ','){
+            p++;
+        } else if (*p != '\0' && *p != '\n'){
+            return false;
+        }
+    }
+    return true;
+}
+static bool read_list(const char *path, cpu_set_t *set){
+    char line[4096];
+    FILE *file = fopen(path, "r");
+    bool ok = file != NULL && fgets(line, sizeof line, file) != NULL && parse_list(line, set);
+    if (file != NULL){
+        fclose(file);
+    }
+    return ok;
+}
+//memory only nodes and cpus outside the affinity mask of the process are left out
+static void read_topology(void){
+    cpu_set_t online;
+    char path[64];
+    int c;
+    if (sched_getaffinity(0, sizeof process_cpus, &process_cpus) != 0){
+        CPU_ZERO(&process_cpus);
+        for (c = 0; c < CPU_SETSIZE; c++){
+            CPU_SET(c, &process_cpus);
+        }
+    }
+    if (!read_list("/sys/devices/system/node/online", &online)){
+        return;
+    }
+    for (c = 0; c < CPU_SETSIZE && node_count < MAX_NODES; c++){
+        cpu_set_t cpus;
+        if (!CPU_ISSET(c, &online)){
+            continue;
+        }
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", c);
+        if (read_list(path, &cpus)){
+            CPU_AND(&cpus, &cpus, &process_cpus);
+            if (CPU_COUNT(&cpus) > 0){
+                node_ids[node_count] = c;
+                node_cpus[node_count++] = cpus;
+            }
+        }
+    }
+}
+int plzo_numa_nodes(void){
+    pthread_once(&topology_once, read_topology);
+    return node_count > 0 ? node_count : 1;
+}
+int plzo_numa_node_id(int node){
+    pthread_once(&topology_once, read_topology);
+    return node_count > 0 ? node_ids[node % node_count] : 0;
+}
+//the cpus of list the process may use, false when list is malformed
+static bool usable(const char *list, cpu_set_t *set){
+    pthread_once(&topology_once, read_topology);
+    if (!parse_list(list, set)){
+        return false;
+    }
+    CPU_AND(set, set, &process_cpus);
+    return true;
+}
+int plzo_cpu_count(const char *list){
+    cpu_set_t set;
+    if (list == NULL){
+        pthread_once(&topology_once, read_topology);
+        return CPU_COUNT(&process_cpus);
+    }
+    return usable(list, &set) ? CPU_COUNT(&set) : -1;
+}
+int plzo_cpu_bind(const char *list){
+    cpu_set_t set;
+    if (!usable(list, &set) || CPU_COUNT(&set) == 0){
+        return LZO_E_ERROR;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0 ? LZO_E_OK : LZO_E_ERROR;
+}
+int plzo_cpu_place(const struct plzo_pool_options_s *options, int node, int index){
+    cpu_set_t set, other;
+    int c;
+    pthread_once(&topology_once, read_topology);
+    set = process_cpus;
+    if (options->cpus != NULL && usable(options->cpus, &other)){
+        set = other;
+    }
+    if (options->avoid != NULL && usable(options->avoid, &other)){
+        for (c = 0; c < CPU_SETSIZE; c++){
+            if (CPU_ISSET(c, &other)){
+                CPU_CLR(c, &set);
+            }
+        }
+    }
+    if (options->numa && node_count > 1){
+        CPU_AND(&other, &set, &node_cpus[node % node_count]);
+        if (CPU_COUNT(&other) > 0){ // a node without any of the listed cpus keeps the whole list
+            set = other;
+        }
+    }
+    if (CPU_COUNT(&set) == 0){
+        return LZO_E_ERROR;
+    }
+    if (options->cpus != NULL){ // one cpu each, in list order
+        int pick = index % CPU_COUNT(&set);
+        for (c = 0; c < CPU_SETSIZE; c++){
+            if (CPU_ISSET(c, &set) && pick-- == 0){
+                CPU_ZERO(&set);
+                CPU_SET(c, &set);
+                break;
+            }
+        }
+    }
+    //also without restrictions, to widen a reused OpenMP thread that an earlier team had pinned
+    return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0 ? LZO_E_OK : LZO_E_ERROR;
+}
+//cpus worth of time the cpu controller of one cgroup directory allows, 0 for no limit
+static double read_quota(const char *dir, bool v2){
+    char path[4200];
+    char word[32];
+    double quota = 0, period = 0;
+    FILE *file;
+    if (v2){ // cpu.max: "max 100000" or "150000 100000"
+        snprintf(path, sizeof path, "%s/cpu.max", dir);
+        file = fopen(path, "r");
+        if (file != NULL && fscanf(file, "%31s %lf", word, &period) == 2 && strcmp(word, "max") != 0){
+            quota = atof(word);
+        }
+    } else { // cpu.cfs_quota_us is -1 without a limit
+        snprintf(path, sizeof path, "%s/cpu.cfs_quota_us", dir);
+        file = fopen(path, "r");
+        if (file != NULL && fscanf(file, "%lf", &quota) == 1){
+            fclose(file);
+            snprintf(path, sizeof path, "%s/cpu.cfs_period_us", dir);
+            file = fopen(path, "r");
+            if (file == NULL || fscanf(file, "%lf", &period) != 1){
+                period = 0;
+            }
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+    return quota > 0 && period > 0 ? quota / period : 0;
+}
+//smallest quota of the cgroup at path below root and of its parents, every one of them applies; inside a
+//container without a cgroup namespace the path does not exist and the walk ends at the mount root
+static double cgroup_quota(const char *root, const char *path, bool v2){
+    char dir[4096];
+    double min = 0;
+    size_t root_len = strlen(root);
+    snprintf(dir, sizeof dir, "%s%s", root, path);
+    for (;;){
+        double quota = read_quota(dir, v2);
+        if (quota > 0 && (min == 0 || quota < min)){
+            min = quota;
+        }
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL || slash < dir + root_len){
+            break;
+        }
+        *slash = '\0';
+    }
+    return min;
+}
+//true if the comma separated controllers of a cgroup v1 hierarchy include cpu
+static bool has_cpu(const char *controllers){
+    size_t len;
+    for (; *controllers != '\0'; controllers += len + (controllers[len] == ',')){
+        len = strcspn(controllers, ",");
+        if (len == 3 && strncmp(controllers, "cpu", 3) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+double plzo_cpu_quota(void){
+    static const char *v1_roots[2] = {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"};
+    char line[4096];
+    double min = 0;
+    int c;
+    FILE *file = fopen("/proc/self/cgroup", "r");
+    while (file != NULL && fgets(line, sizeof line, file) != NULL){
+        //hierarchy-id:controllers:path, the cgroup v2 line is 0::path
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':');
+        char *path = controllers != NULL ? strchr(controllers + 1, ':') : NULL;
+        double quota = 0;
+        if (path == NULL){
+            continue;
+        }
+        *controllers++ = '\0';
+        *path++ = '\0';
+        if (strcmp(line, "0") == 0 && *controllers == '\0'){
+            quota = cgroup_quota("/sys/fs/cgroup", path, true);
+        } else if (has_cpu(controllers)){
+            for (c = 0; c < 2 && quota == 0; c++){
+                quota = cgroup_quota(v1_roots[c], path, false);
+            }
+        }
+        if (quota > 0 && (min == 0 || quota < min)){
+            min = quota;
+        }
+    }
+    if (file != NULL){
+        fclose(file);
+    }
+    return min;
+}
+int plzo_cpu_threads(const char *list){
+    int threads = plzo_cpu_count(list);
+    double quota = plzo_cpu_quota();
+    if (quota > 0 && threads > (int) ceil(quota)){ // more threads than the quota only get throttled
+        threads = (int) ceil(quota);
+    }
+    return threads > 0 ? threads : 1;
+}
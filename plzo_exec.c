@@ -0,0 +1,293 @@
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+static const char *exec_names[PLZO_EXEC_KINDS] = {"pool", "openmp", "serial"};
+
+//the pool brings its own threads and statistics, the others keep them here
+struct plzo_exec_s {
+    int kind;
+    int thread_count;
+    plzo_pool *pool;
+    lzo_voidp *wrkmem; // one per thread
+    int *tids;
+    struct plzo_worker_stats_s *stats;
+    unsigned long jobs; // runs so far, names them in traces
+    int schedule; // omp_sched_t of plzo_exec_schedule, 0 leaves OMP_SCHEDULE in effect
+    int chunk;
+    struct plzo_pool_options_s options; // with copies of the cpu lists, for placing OpenMP threads
+    int nodes;
+    unsigned long serial; // names the executor whose placement the OpenMP threads carry
+};
+
+#ifdef _OPENMP
+//the threads of every OpenMP team come from one process wide pool, so a team of another executor
+//(another size or placement) may have moved them since this executor placed them
+static unsigned long exec_serial = 0;
+static unsigned long placed_serial = 0;
+#endif
+
+static double seconds(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+//adds the time since wall_start and cpu_start to the statistics of a thread
+static void account(struct plzo_worker_stats_s *stats, double wall_start, double cpu_start, int blocks){
+    stats->busy += seconds(CLOCK_MONOTONIC) - wall_start;
+    stats->cpu += seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    stats->blocks += blocks;
+    stats->ranges++;
+}
+#ifdef _OPENMP
+//pins thread t of a team of team threads as the options of the executor ask, node ranges follow the
+//team size, and records its tid for the counters
+static void place_thread(plzo_exec *exec, int t, int team){
+    int nodes = exec->nodes < team ? exec->nodes : team;
+    int node = t * nodes / team;
+    if (plzo_cpu_place(&exec->options, node, t - (node * team + nodes - 1) / nodes) != LZO_E_OK){
+        printf("plzo: cannot place OpenMP thread %d\n", t);
+    }
+    exec->tids[t] = (int) syscall(SYS_gettid);
+    plzo_trace_thread("openmp", t);
+}
+//the blocks are shared out by the run-sched-var, OMP_SCHEDULE unless plzo_exec_schedule set one, so
+//static, dynamic and guided can be compared without rebuilding
+static void run_openmp(plzo_exec *exec, int op, struct plzo_block_s *blocks, int block_count, unsigned long job){
+    int place = placed_serial != exec->serial;
+    if (exec->schedule != 0){
+        omp_set_schedule((omp_sched_t) exec->schedule, exec->chunk);
+    }
+    placed_serial = exec->serial;
+    #pragma omp parallel num_threads(exec->thread_count)
+    {
+        int t = omp_get_thread_num();
+        if (place){ // before the clocks start, it may move the thread
+            place_thread(exec, t, omp_get_num_threads());
+        }
+        double wall_start = seconds(CLOCK_MONOTONIC);
+        double cpu_start = seconds(CLOCK_THREAD_CPUTIME_ID);
+        int n = 0;
+        int c;
+        #pragma omp for schedule(runtime) nowait
+        for (c = 0; c < block_count; c++){
+            blocks[c].status = plzo_block_run(op, &blocks[c], exec->wrkmem[t], job, c);
+            n++;
+        }
+        account(&exec->stats[t], wall_start, cpu_start, n);
+    }
+}
+#endif
+int plzo_exec_kind(const char *name){
+    int c;
+    for (c = 0; c < PLZO_EXEC_KINDS; c++){
+        if (strcmp(name, exec_names[c]) == 0){
+            return c;
+        }
+    }
+    return -1;
+}
+const char *plzo_exec_kind_name(int kind){
+    return kind >= 0 && kind < PLZO_EXEC_KINDS ? exec_names[kind] : NULL;
+}
+plzo_exec *plzo_exec_create(int kind, int thread_count, const struct plzo_pool_options_s *options){
+#ifndef _OPENMP
+    if (kind == PLZO_EXEC_OPENMP){
+        printf("built without OpenMP, compile plzo_exec.c with -fopenmp\n");
+        return NULL;
+    }
+#endif
+    if (kind < 0 || kind >= PLZO_EXEC_KINDS){
+        printf("unknown executor %d\n", kind);
+        return NULL;
+    }
+    if (thread_count < 1 || kind == PLZO_EXEC_SERIAL){
+        thread_count = 1;
+    }
+    plzo_exec *exec = (plzo_exec *) xmalloc(sizeof(plzo_exec));
+    exec->kind = kind;
+    exec->thread_count = thread_count;
+    exec->pool = NULL;
+    exec->wrkmem = NULL;
+    exec->tids = NULL;
+    exec->stats = NULL;
+    exec->jobs = 0;
+    exec->schedule = 0;
+    exec->chunk = 0;
+    exec->serial = 0;
+    memset(&exec->options, 0, sizeof exec->options);
+    if (options != NULL){
+        exec->options.numa = options->numa;
+        exec->options.cpus = options->cpus != NULL ? strdup(options->cpus) : NULL;
+        exec->options.avoid = options->avoid != NULL ? strdup(options->avoid) : NULL;
+    }
+    exec->nodes = 1;
+    if (kind == PLZO_EXEC_POOL){
+        exec->pool = plzo_pool_create_with(thread_count, options);
+        return exec;
+    }
+    //a team may start with fewer threads than asked for, the slots it leaves stay empty
+    exec->wrkmem = (lzo_voidp *) xmalloc(sizeof(lzo_voidp) * thread_count);
+    memset(exec->wrkmem, 0, sizeof(lzo_voidp) * thread_count);
+    exec->tids = (int *) xmalloc(sizeof(int) * thread_count);
+    memset(exec->tids, 0, sizeof(int) * thread_count);
+    exec->stats = (struct plzo_worker_stats_s *) xmalloc(sizeof(struct plzo_worker_stats_s) * thread_count);
+    memset(exec->stats, 0, sizeof(struct plzo_worker_stats_s) * thread_count);
+    if (kind == PLZO_EXEC_SERIAL){
+        exec->wrkmem[0] = plzo_alloc(LZO1X_1_MEM_COMPRESS);
+        exec->tids[0] = (int) syscall(SYS_gettid);
+        return exec;
+    }
+#ifdef _OPENMP
+    exec->nodes = exec->options.numa ? plzo_numa_nodes() : 1;
+    exec->serial = ++exec_serial;
+    placed_serial = exec->serial;
+    //starts the team, later regions run with no more threads than it got (OMP_THREAD_LIMIT, OMP_DYNAMIC)
+    #pragma omp parallel num_threads(thread_count)
+    {
+        int t = omp_get_thread_num();
+        #pragma omp single
+        exec->thread_count = omp_get_num_threads();
+        place_thread(exec, t, exec->thread_count);
+        exec->wrkmem[t] = plzo_alloc(LZO1X_1_MEM_COMPRESS);
+    }
+#endif
+    return exec;
+}
+void plzo_exec_destroy(plzo_exec *exec){
+    int c;
+    if (exec->pool != NULL){
+        plzo_pool_destroy(exec->pool);
+    }
+    for (c = 0; exec->wrkmem != NULL && c < exec->thread_count; c++){
+        plzo_free(exec->wrkmem[c]);
+    }
+    free(exec->wrkmem);
+    free(exec->tids);
+    free(exec->stats);
+    free((char *) exec->options.cpus);
+    free((char *) exec->options.avoid);
+    free(exec);
+}
+const char *plzo_exec_name(const plzo_exec *exec){
+    return exec_names[exec->kind];
+}
+int plzo_exec_threads(const plzo_exec *exec){
+    return exec->thread_count;
+}
+int plzo_exec_worker_tid(const plzo_exec *exec, int index){
+    return exec->pool != NULL ? plzo_pool_worker_tid(exec->pool, index) : exec->tids[index];
+}
+plzo_pool *plzo_exec_pool(const plzo_exec *exec){
+    return exec->pool;
+}
+int plzo_exec_run(plzo_exec *exec, int op, struct plzo_block_s *blocks, int block_count){
+    int c;
+    if (exec->pool != NULL){
+        plzo_job *job = plzo_submit(exec->pool, op, blocks, block_count, NULL, NULL);
+        int r = plzo_wait(job);
+        plzo_release(job);
+        return r;
+    }
+    unsigned long long held = plzo_job_bytes(op, blocks, block_count);
+    if (held != 0 && plzo_memory_acquire(held) != LZO_E_OK){ // rejected as plzo_submit does
+        for (c = 0; c < block_count; c++){
+            blocks[c].status = LZO_E_OUT_OF_MEMORY;
+        }
+        return LZO_E_OUT_OF_MEMORY;
+    }
+    unsigned long job = ++exec->jobs;
+#ifdef _OPENMP
+    if (exec->kind == PLZO_EXEC_OPENMP){
+        run_openmp(exec, op, blocks, block_count, job);
+    }
+#endif
+    if (exec->kind == PLZO_EXEC_SERIAL){
+        double wall_start = seconds(CLOCK_MONOTONIC);
+        double cpu_start = seconds(CLOCK_THREAD_CPUTIME_ID);
+        for (c = 0; c < block_count; c++){
+            blocks[c].status = plzo_block_run(op, &blocks[c], exec->wrkmem[0], job, c);
+        }
+        account(&exec->stats[0], wall_start, cpu_start, block_count);
+    }
+    if (held != 0){
+        plzo_memory_release(held);
+    }
+    for (c = 0; c < block_count; c++){
+        if (blocks[c].status != LZO_E_OK){
+            return blocks[c].status;
+        }
+    }
+    return LZO_E_OK;
+}
+int plzo_exec_schedule(plzo_exec *exec, const char *schedule){
+#ifdef _OPENMP
+    static const struct {
+        const char *name;
+        omp_sched_t kind;
+    } kinds[] = {{"static", omp_sched_static}, {"dynamic", omp_sched_dynamic}, {"guided", omp_sched_guided},
+                 {"auto", omp_sched_auto}};
+    size_t len = strcspn(schedule, ",");
+    int c;
+    if (exec->kind != PLZO_EXEC_OPENMP){
+        return LZO_E_ERROR;
+    }
+    for (c = 0; c < (int) (sizeof kinds / sizeof kinds[0]); c++){
+        if (strlen(kinds[c].name) == len && strncmp(schedule, kinds[c].name, len) == 0){
+            exec->schedule = (int) kinds[c].kind;
+            exec->chunk = schedule[len] == ',' ? atoi(schedule + len + 1) : 0; // 0 is the default chunk
+            return LZO_E_OK;
+        }
+    }
+#else
+    (void) exec;
+    (void) schedule;
+#endif
+    return LZO_E_ERROR;
+}
+int plzo_exec_batch(plzo_exec *exec, int op, struct plzo_block_s *blocks, int block_count,
+                    lzo_bytep arena, lzo_uint arena_size){
+    int r = plzo_batch_layout(op, blocks, block_count, arena, arena_size);
+    return r == LZO_E_OK ? plzo_exec_run(exec, op, blocks, block_count) : r;
+}
+void plzo_exec_stats(const plzo_exec *exec, int index, struct plzo_worker_stats_s *stats){
+    if (exec->pool != NULL){
+        plzo_pool_stats(exec->pool, index, stats);
+    } else {
+        *stats = exec->stats[index];
+    }
+}
+void plzo_exec_stats_reset(plzo_exec *exec){
+    if (exec->pool != NULL){
+        plzo_pool_stats_reset(exec->pool);
+    } else {
+        memset(exec->stats, 0, sizeof(struct plzo_worker_stats_s) * exec->thread_count);
+    }
+}
+double plzo_exec_imbalance(const plzo_exec *exec){
+    double max = 0, sum = 0;
+    int c;
+    if (exec->pool != NULL){
+        return plzo_pool_imbalance(exec->pool);
+    }
+    for (c = 0; c < exec->thread_count; c++){
+        sum += exec->stats[c].busy;
+        max = exec->stats[c].busy > max ? exec->stats[c].busy : max;
+    }
+    return sum > 0 ? max / (sum / exec->thread_count) : 0;
+}
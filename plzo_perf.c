@@ -0,0 +1,151 @@
+#include <lzo/lzoconf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+#include "plzo_bench.h"
+
+const char *perf_names[PERF_COUNTERS] = {"cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"};
+
+#define CACHE_EVENT(cache, result) \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | (result) << 16)
+
+static const struct {
+    lzo_uint32_t type;
+    unsigned long long config;
+} perf_events[PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+//one event group per worker, read in a single call, order maps the read values to counters
+struct perf_group_s {
+    int leader;
+    int fds[PERF_COUNTERS];
+    int order[PERF_COUNTERS];
+    int nr;
+};
+struct bench_perf_s {
+    int threads;
+    struct perf_group_s *groups;
+};
+
+static int open_event(int counter, int tid, int group_fd){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = perf_events[counter].type;
+    attr.config = perf_events[counter].config;
+    attr.disabled = group_fd < 0; // members follow their leader
+    attr.exclude_kernel = 1; // allowed up to perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = (int) syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && counter == PERF_LLC_MISSES){ // no last level read miss event, take the generic cache miss one
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        fd = (int) syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
+static void close_group(struct perf_group_s *g){
+    int c;
+    for (c = 0; c < PERF_COUNTERS; c++){
+        if (g->fds[c] >= 0){
+            close(g->fds[c]);
+        }
+    }
+}
+//the first counter that opens leads the group, the others join it or are left out
+static bool open_group(struct perf_group_s *g, int tid){
+    int c;
+    g->leader = -1;
+    g->nr = 0;
+    for (c = 0; c < PERF_COUNTERS; c++){
+        g->fds[c] = open_event(c, tid, g->leader);
+        if (g->fds[c] >= 0){
+            if (g->leader < 0){
+                g->leader = g->fds[c];
+            }
+            g->order[g->nr++] = c;
+        }
+    }
+    return g->leader >= 0;
+}
+bench_perf *perf_open(const plzo_exec *exec){
+    static bool warned = false;
+    int c;
+    bench_perf *perf = (bench_perf *) xmalloc(sizeof(bench_perf));
+    perf->threads = plzo_exec_threads(exec);
+    perf->groups = (struct perf_group_s *) xmalloc(sizeof(struct perf_group_s) * perf->threads);
+    for (c = 0; c < perf->threads; c++){
+        if (!open_group(&perf->groups[c], plzo_exec_worker_tid(exec, c))){
+            if (!warned){
+                printf("perf counters unavailable (%s), check /proc/sys/kernel/perf_event_paranoid\n", strerror(errno));
+                warned = true;
+            }
+            while (c-- > 0){
+                close_group(&perf->groups[c]);
+            }
+            free(perf->groups);
+            free(perf);
+            return NULL;
+        }
+    }
+    return perf;
+}
+void perf_start(bench_perf *perf){
+    int c;
+    for (c = 0; c < perf->threads; c++){
+        ioctl(perf->groups[c].leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->groups[c].leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+//counters are scaled up when the kernel had to multiplex them, a group that never ran is invalid
+void perf_stop(bench_perf *perf, struct bench_counters_s *workers){
+    uint64_t values[3 + PERF_COUNTERS];
+    int c, i;
+    for (c = 0; c < perf->threads; c++){
+        ioctl(perf->groups[c].leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    for (c = 0; c < perf->threads; c++){
+        const struct perf_group_s *g = &perf->groups[c];
+        memset(&workers[c], 0, sizeof workers[c]);
+        ssize_t n = read(g->leader, values, sizeof values);
+        if (n < (ssize_t) (sizeof(uint64_t) * (3 + g->nr)) || values[2] == 0){
+            continue;
+        }
+        double scale = (double) values[1] / values[2];
+        for (i = 0; i < g->nr; i++){
+            workers[c].value[g->order[i]] = (unsigned long long) (values[3 + i] * scale + 0.5);
+            workers[c].valid[g->order[i]] = true;
+        }
+    }
+}
+void perf_close(bench_perf *perf){
+    int c;
+    if (perf == NULL){
+        return;
+    }
+    for (c = 0; c < perf->threads; c++){
+        close_group(&perf->groups[c]);
+    }
+    free(perf->groups);
+    free(perf);
+}
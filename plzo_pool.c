@@ -0,0 +1,527 @@
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+#define MAX_NODES 64
+
+struct plzo_job_s {
+    unsigned long id; // submission number, names the job in traces
+    struct plzo_block_s *blocks;
+    int block_count;
+    int op;
+    int next[MAX_NODES]; // next block to hand out from the range of each node
+    int end[MAX_NODES];
+    int unassigned; // blocks not handed out yet
+    int grain; // blocks handed out per dequeue
+    int pending; // blocks not finished yet
+    int status;
+    int done;
+    int refs; // the ticket and a callback still running, the job is freed once both let go
+    unsigned long long held; // taken from the memory budget by the submit, given back on completion
+    plzo_callback callback;
+    void *user;
+    plzo_pool *pool;
+    plzo_job *queue_next;
+#ifdef PLZO_PROBES
+    unsigned long long submitted;
+#endif
+};
+//each worker owns its compression work memory
+struct plzo_worker_s {
+    plzo_pool *pool;
+    pthread_t thread;
+    int tid; // kernel thread id, 0 until the worker has started
+    int node; // range of every job this worker takes blocks from first
+    lzo_voidp wrkmem;
+    struct plzo_worker_stats_s stats;
+#ifdef PLZO_PROBES
+    struct plzo_probes_s probes;
+#endif
+};
+struct plzo_pool_s {
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signalled when a job is queued
+    pthread_cond_t done; // broadcast when a job completes
+    plzo_job *head; // jobs that still have blocks to hand out
+    plzo_job *tail;
+    int stop;
+    int thread_count;
+    struct plzo_worker_s *workers;
+    struct plzo_pool_options_s options; // with copies of the cpu lists
+    int nodes; // node ranges of every job
+    int *node_first; // first worker of each node, and thread_count after the last
+    int efd;
+    unsigned long jobs; // submitted so far
+};
+
+static double seconds(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#ifdef PLZO_PROBES
+//histograms of the pool worker running on this thread, blocks run elsewhere count into a spare
+static __thread struct plzo_probes_s *thread_probes = NULL;
+static __thread struct plzo_probes_s spare_probes;
+#endif
+int plzo_block_run(int op, struct plzo_block_s *block, lzo_voidp wrkmem, unsigned long job, long index){
+    int r;
+#ifdef PLZO_PROBES
+    struct plzo_probes_s *probes = thread_probes != NULL ? thread_probes : &spare_probes;
+#endif
+    if (op & PLZO_TOUCH){
+        if (block->data_size > 0){
+            memset(block->data, 0, block->data_size);
+        }
+        if (block->out_size > 0){
+            memset(block->out, 0, block->out_size);
+        }
+        return LZO_E_OK;
+    }
+    if ((op & PLZO_DECOMPRESS) == 0){
+        if (op & PLZO_CHECKSUM){
+            unsigned long long trace = plzo_trace_begin();
+            PLZO_TSC(sum_start);
+            block->checksum = lzo_adler32(1, block->data, block->data_size);
+            PLZO_PROBE(probes, PLZO_PROBE_CHECKSUM, sum_start);
+            plzo_trace_end("checksum", trace, job, index, block->data_size);
+        }
+        unsigned long long trace = plzo_trace_begin();
+        PLZO_TSC(codec_start);
+        r = lzo1x_1_compress(block->data, block->data_size, block->out, &block->out_size, wrkmem);
+        PLZO_PROBE(probes, PLZO_PROBE_CODEC, codec_start);
+        plzo_trace_end("compress", trace, job, index, block->data_size);
+        return r;
+    }
+    unsigned long long trace = plzo_trace_begin();
+    PLZO_TSC(codec_start);
+    r = lzo1x_decompress_safe(block->data, block->data_size, block->out, &block->out_size, NULL);
+    PLZO_PROBE(probes, PLZO_PROBE_CODEC, codec_start);
+    plzo_trace_end("decompress", trace, job, index, block->out_size);
+    if (r == LZO_E_OK && (op & PLZO_CHECKSUM)){
+        trace = plzo_trace_begin();
+        PLZO_TSC(sum_start);
+        if (lzo_adler32(1, block->out, block->out_size) != block->checksum){
+            r = LZO_E_ERROR;
+        }
+        PLZO_PROBE(probes, PLZO_PROBE_CHECKSUM, sum_start);
+        plzo_trace_end("checksum", trace, job, index, block->out_size);
+    }
+    return r;
+}
+//drops a reference to the job and frees it with the last one
+static void unref_job(plzo_pool *pool, plzo_job *job){
+    pthread_mutex_lock(&pool->lock);
+    int refs = --job->refs;
+    pthread_mutex_unlock(&pool->lock);
+    if (refs == 0){
+        free(job);
+    }
+}
+//the callback runs after the job is marked done and holds a reference of its own, so a waiter or the
+//callback itself may release the ticket meanwhile and the job stays valid until the callback returns
+static void finish_job(plzo_pool *pool, plzo_job *job){
+    uint64_t one = 1;
+    plzo_callback callback = job->callback;
+    void *user = job->user;
+    if (job->held != 0){ // before done, so a caller that waits and submits again finds the room
+        plzo_memory_release(job->held);
+    }
+    pthread_mutex_lock(&pool->lock);
+    job->done = 1;
+    if (callback != NULL){
+        job->refs++;
+    }
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+    if (callback != NULL){
+        callback(job, user);
+        unref_job(pool, job);
+    }
+    if (write(pool->efd, &one, sizeof one) != sizeof one){
+        perror("plzo eventfd");
+    }
+}
+static void *worker_main(void *arg){
+    struct plzo_worker_s *worker = (struct plzo_worker_s *) arg;
+    plzo_pool *pool = worker->pool;
+    int c;
+    int index = (int) (worker - pool->workers);
+    //placed before the work memory is allocated, so it is first touched on the node
+    if (plzo_cpu_place(&pool->options, worker->node, index - pool->node_first[worker->node]) != LZO_E_OK){
+        printf("plzo: cannot place worker %d on node %d\n", index, plzo_numa_node_id(worker->node));
+    }
+    worker->wrkmem = plzo_alloc(LZO1X_1_MEM_COMPRESS);
+    pthread_mutex_lock(&pool->lock);
+    worker->tid = (int) syscall(SYS_gettid);
+#ifdef PLZO_PROBES
+    thread_probes = &worker->probes;
+#endif
+    plzo_trace_thread("worker", index);
+    pthread_cond_broadcast(&pool->done);
+    for (;;){
+        while (pool->head == NULL && !pool->stop){
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->head == NULL){
+            break;
+        }
+        plzo_job *job = pool->head;
+        int n = worker->node;
+        for (c = 0; c < pool->nodes && job->next[n] == job->end[n]; c++){
+            n = (n + 1) % pool->nodes; // the own range is done, help the next node
+        }
+        int first = job->next[n];
+        int last = first + job->grain;
+        if (last > job->end[n]){
+            last = job->end[n];
+        }
+        job->next[n] = last;
+        job->unassigned -= last - first;
+        if (job->unassigned == 0){ // every block handed out, dequeue the job
+            pool->head = job->queue_next;
+            if (pool->head == NULL){
+                pool->tail = NULL;
+            }
+        }
+        PLZO_PROBE(&worker->probes, PLZO_PROBE_QUEUE, job->submitted);
+        pthread_mutex_unlock(&pool->lock);
+        double wall_start = seconds(CLOCK_MONOTONIC);
+        double cpu_start = seconds(CLOCK_THREAD_CPUTIME_ID);
+        int status = LZO_E_OK;
+        for (c = first; c < last; c++){
+            int r = plzo_block_run(job->op, &job->blocks[c], worker->wrkmem, job->id, c);
+            job->blocks[c].status = r;
+            if (r != LZO_E_OK && status == LZO_E_OK){
+                status = r;
+            }
+        }
+        //accounted before the job can complete, so a waiter sees them
+        worker->stats.busy += seconds(CLOCK_MONOTONIC) - wall_start;
+        worker->stats.cpu += seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+        worker->stats.blocks += last - first;
+        worker->stats.ranges++;
+        PLZO_TSC(handoff_start);
+        pthread_mutex_lock(&pool->lock);
+        if (status != LZO_E_OK && job->status == LZO_E_OK){
+            job->status = status;
+        }
+        job->pending -= last - first;
+        if (job->pending == 0){
+            pthread_mutex_unlock(&pool->lock);
+            finish_job(pool, job);
+            pthread_mutex_lock(&pool->lock);
+        }
+        PLZO_PROBE(&worker->probes, PLZO_PROBE_HANDOFF, handoff_start);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+plzo_pool *plzo_pool_create(int thread_count){
+    return plzo_pool_create_with(thread_count, NULL);
+}
+static const char *copy_list(const char *list){
+    char *copy = NULL;
+    if (list != NULL){
+        copy = (char *) xmalloc(strlen(list) + 1);
+        strcpy(copy, list);
+    }
+    return copy;
+}
+plzo_pool *plzo_pool_create_with(int thread_count, const struct plzo_pool_options_s *options){
+    int c;
+    if (thread_count < 1){
+        thread_count = 1;
+    }
+    plzo_pool *pool = (plzo_pool *) xmalloc(sizeof(plzo_pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->stop = 0;
+    pool->thread_count = thread_count;
+    pool->jobs = 0;
+    pool->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool->efd < 0){
+        perror("plzo eventfd");
+        exit(1);
+    }
+    memset(&pool->options, 0, sizeof pool->options);
+    if (options != NULL){
+        pool->options.numa = options->numa;
+        pool->options.cpus = copy_list(options->cpus);
+        pool->options.avoid = copy_list(options->avoid);
+    }
+    //contiguous groups of workers per node, node n starts at worker ceil(n * threads / nodes)
+    pool->nodes = pool->options.numa ? plzo_numa_nodes() : 1;
+    if (pool->nodes > thread_count){
+        pool->nodes = thread_count;
+    }
+    if (pool->nodes > MAX_NODES){
+        pool->nodes = MAX_NODES;
+    }
+    pool->node_first = (int *) xmalloc(sizeof(int) * (pool->nodes + 1));
+    for (c = 0; c <= pool->nodes; c++){
+        pool->node_first[c] = (c * thread_count + pool->nodes - 1) / pool->nodes;
+    }
+    pool->workers = (struct plzo_worker_s *) xmalloc(sizeof(struct plzo_worker_s) * thread_count);
+    for (c = 0; c < thread_count; c++){
+        pool->workers[c].pool = pool;
+        pool->workers[c].tid = 0;
+        pool->workers[c].node = c * pool->nodes / thread_count;
+        memset(&pool->workers[c].stats, 0, sizeof(struct plzo_worker_stats_s));
+#ifdef PLZO_PROBES
+        memset(&pool->workers[c].probes, 0, sizeof(struct plzo_probes_s));
+#endif
+        pool->workers[c].wrkmem = NULL;
+        pthread_create(&pool->workers[c].thread, NULL, worker_main, (void *) &pool->workers[c]);
+    }
+    pthread_mutex_lock(&pool->lock); // every worker has a tid once the pool is returned
+    for (c = 0; c < thread_count; c++){
+        while (pool->workers[c].tid == 0){
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return pool;
+}
+//queued jobs are drained before the workers exit
+void plzo_pool_destroy(plzo_pool *pool){
+    int c;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (c = 0; c < pool->thread_count; c++){
+        pthread_join(pool->workers[c].thread, NULL);
+        plzo_free(pool->workers[c].wrkmem);
+    }
+    free(pool->workers);
+    free(pool->node_first);
+    free((char *) pool->options.cpus);
+    free((char *) pool->options.avoid);
+    close(pool->efd);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+int plzo_pool_threads(const plzo_pool *pool){
+    return pool->thread_count;
+}
+int plzo_pool_nodes(const plzo_pool *pool){
+    return pool->nodes;
+}
+int plzo_pool_worker_tid(const plzo_pool *pool, int index){
+    return pool->workers[index].tid;
+}
+void plzo_pool_stats(const plzo_pool *pool, int index, struct plzo_worker_stats_s *stats){
+    *stats = pool->workers[index].stats;
+}
+void plzo_pool_stats_reset(plzo_pool *pool){
+    int c;
+    for (c = 0; c < pool->thread_count; c++){
+        memset(&pool->workers[c].stats, 0, sizeof(struct plzo_worker_stats_s));
+    }
+}
+double plzo_pool_imbalance(const plzo_pool *pool){
+    double max = 0, sum = 0;
+    int c;
+    for (c = 0; c < pool->thread_count; c++){
+        double busy = pool->workers[c].stats.busy;
+        sum += busy;
+        max = busy > max ? busy : max;
+    }
+    return sum > 0 ? max / (sum / pool->thread_count) : 0;
+}
+#ifdef PLZO_PROBES
+void plzo_pool_probes(const plzo_pool *pool, int index, struct plzo_probes_s *probes){
+    *probes = pool->workers[index].probes;
+}
+void plzo_pool_probes_reset(plzo_pool *pool){
+    int c;
+    for (c = 0; c < pool->thread_count; c++){
+        memset(&pool->workers[c].probes, 0, sizeof(struct plzo_probes_s));
+    }
+}
+#endif
+int plzo_pool_eventfd(const plzo_pool *pool){
+    return pool->efd;
+}
+unsigned long long plzo_job_bytes(int op, const struct plzo_block_s *blocks, int block_count){
+    unsigned long long bytes = 0;
+    int c;
+    if ((op & (PLZO_RESERVED | PLZO_TOUCH)) != 0 || plzo_memory_limit() == 0){
+        return 0;
+    }
+    for (c = 0; c < block_count; c++){
+        bytes += (unsigned long long) blocks[c].data_size + blocks[c].out_size;
+    }
+    return bytes;
+}
+plzo_job *plzo_submit(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+                      plzo_callback callback, void *user){
+    int n;
+    plzo_job *job = (plzo_job *) xmalloc(sizeof(plzo_job));
+    job->blocks = blocks;
+    job->block_count = block_count;
+    job->op = op;
+    //node n processes the blocks in proportion to its workers, the ranges PLZO_TOUCH placed its buffers for
+    for (n = 0; n < pool->nodes; n++){
+        job->next[n] = (int) ((long long) block_count * pool->node_first[n] / pool->thread_count);
+        job->end[n] = (int) ((long long) block_count * pool->node_first[n + 1] / pool->thread_count);
+    }
+    job->unassigned = block_count;
+    job->grain = block_count / (pool->thread_count * 4); // large batches of small blocks would otherwise serialize on the lock
+    if (job->grain < 1){
+        job->grain = 1;
+    }
+    job->pending = block_count;
+    job->status = LZO_E_OK;
+    job->done = 0;
+    job->refs = 1;
+    job->held = plzo_job_bytes(op, blocks, block_count);
+    job->callback = callback;
+    job->user = user;
+    job->pool = pool;
+    job->queue_next = NULL;
+    job->id = 0;
+#ifdef PLZO_PROBES
+    job->submitted = plzo_tsc();
+#endif
+    if (job->held != 0 && plzo_memory_acquire(job->held) != LZO_E_OK){ // larger than the whole budget
+        for (n = 0; n < block_count; n++){
+            blocks[n].status = LZO_E_OUT_OF_MEMORY;
+        }
+        job->status = LZO_E_OUT_OF_MEMORY;
+        job->held = 0;
+        block_count = 0;
+    }
+    if (block_count <= 0){ // nothing to do, complete right away
+        finish_job(pool, job);
+        return job;
+    }
+    pthread_mutex_lock(&pool->lock);
+    job->id = ++pool->jobs;
+    if (pool->tail != NULL){
+        pool->tail->queue_next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    if (block_count == 1){
+        pthread_cond_signal(&pool->work);
+    } else {
+        pthread_cond_broadcast(&pool->work);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+int plzo_test(plzo_job *job){
+    pthread_mutex_lock(&job->pool->lock);
+    int done = job->done;
+    pthread_mutex_unlock(&job->pool->lock);
+    return done;
+}
+int plzo_wait(plzo_job *job){
+    plzo_pool *pool = job->pool;
+    unsigned long long trace = plzo_trace_begin();
+    pthread_mutex_lock(&pool->lock);
+    while (!job->done){
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    int status = job->status;
+    pthread_mutex_unlock(&pool->lock);
+    plzo_trace_end("wait", trace, job->id, -1, 0);
+    return status;
+}
+int plzo_job_status(const plzo_job *job){
+    return job->status;
+}
+void *plzo_job_user(const plzo_job *job){
+    return job->user;
+}
+unsigned long plzo_job_id(const plzo_job *job){
+    return job->id;
+}
+void plzo_release(plzo_job *job){
+    unref_job(job->pool, job);
+}
+lzo_uint plzo_batch_bound(int op, const struct plzo_block_s *blocks, int block_count){
+    lzo_uint total = 0;
+    int c;
+    for (c = 0; c < block_count; c++){
+        total += (op & PLZO_DECOMPRESS) == 0 ? PLZO_COMPRESS_BOUND(blocks[c].data_size) : blocks[c].out_size;
+    }
+    return total;
+}
+int plzo_batch_layout(int op, struct plzo_block_s *blocks, int block_count, lzo_bytep arena, lzo_uint arena_size){
+    lzo_uint offset = 0;
+    int c;
+    if (plzo_batch_bound(op, blocks, block_count) > arena_size){
+        return LZO_E_OUTPUT_OVERRUN;
+    }
+    for (c = 0; c < block_count; c++){ // carve the arena in item order
+        if ((op & PLZO_DECOMPRESS) == 0){
+            blocks[c].out_size = PLZO_COMPRESS_BOUND(blocks[c].data_size);
+        }
+        blocks[c].out = arena + offset;
+        offset += blocks[c].out_size;
+    }
+    return LZO_E_OK;
+}
+plzo_job *plzo_batch_submit(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+                            lzo_bytep arena, lzo_uint arena_size, plzo_callback callback, void *user){
+    if (plzo_batch_layout(op, blocks, block_count, arena, arena_size) != LZO_E_OK){
+        return NULL;
+    }
+    return plzo_submit(pool, op, blocks, block_count, callback, user);
+}
+int plzo_batch(plzo_pool *pool, int op, struct plzo_block_s *blocks, int block_count,
+               lzo_bytep arena, lzo_uint arena_size){
+    plzo_job *job = plzo_batch_submit(pool, op, blocks, block_count, arena, arena_size, NULL, NULL);
+    if (job == NULL){
+        return LZO_E_OUTPUT_OVERRUN;
+    }
+    int r = plzo_wait(job);
+    plzo_release(job);
+    return r;
+}
+//zlib's adler32_combine
+lzo_uint32_t plzo_adler32_combine(lzo_uint32_t adler1, lzo_uint32_t adler2, unsigned long long len2){
+    const unsigned long base = 65521;
+    unsigned long rem = (unsigned long) (len2 % base);
+    unsigned long sum1 = adler1 & 0xffff;
+    unsigned long sum2 = (rem * sum1) % base;
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
+    if (sum1 >= base){
+        sum1 -= base;
+    }
+    if (sum1 >= base){
+        sum1 -= base;
+    }
+    if (sum2 >= (base << 1)){
+        sum2 -= (base << 1);
+    }
+    if (sum2 >= base){
+        sum2 -= base;
+    }
+    return (lzo_uint32_t) (sum1 | (sum2 << 16));
+}
@@ -0,0 +1,297 @@
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+#define SLOT_FREE 0 // filling with input
+#define SLOT_BUSY 1 // submitted to the pool
+#define SLOT_DONE 2 // finished, waiting to be read
+
+struct plzo_slot_s {
+    plzo_stream *stream;
+    struct plzo_block_s block;
+    plzo_job *job;
+    lzo_bytep in;
+    lzo_uint in_cap;
+    lzo_uint in_len;
+    lzo_bytep out;
+    lzo_uint out_cap;
+    lzo_uint raw_len; // decompression: raw length announced by the frame header
+    lzo_uint comp_len; // decompression: payload length announced by the frame header
+    int state;
+};
+//slots form a ring, head is the oldest submitted block and the one after the last submitted is being filled
+struct plzo_stream_s {
+    plzo_pool *pool;
+    int op;
+    lzo_uint block_size;
+    int depth;
+    unsigned long long held; // taken from the memory budget for the slot buffers
+    struct plzo_slot_s *slots;
+    int head;
+    int count; // submitted and not read yet
+    unsigned char header[PLZO_FRAME_HEADER_SIZE]; // partial frame header while decompressing
+    int header_len;
+    int error; // set when the input is not a valid frame sequence
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    void (*notify)(void *user);
+    void *notify_user;
+};
+
+//grows a slot buffer, the old contents are not kept
+static void reserve(lzo_bytep *buf, lzo_uint *cap, lzo_uint len){
+    if (*cap < len){
+        plzo_buffer_put(*buf);
+        *buf = (lzo_bytep) plzo_buffer_get(len);
+        *cap = len;
+    }
+}
+static void slot_done(plzo_job *job, void *user){
+    struct plzo_slot_s *slot = (struct plzo_slot_s *) user;
+    plzo_stream *stream = slot->stream;
+    void (*notify)(void *user) = NULL;
+    void *notify_user = NULL;
+    (void) job;
+    pthread_mutex_lock(&stream->lock);
+    slot->state = SLOT_DONE;
+    if (stream->notify != NULL && slot == &stream->slots[stream->head]){
+        notify = stream->notify;
+        notify_user = stream->notify_user;
+        stream->notify = NULL;
+    }
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    if (notify != NULL){
+        notify(notify_user);
+    }
+}
+static struct plzo_slot_s *filling_slot(plzo_stream *stream){
+    return &stream->slots[(stream->head + stream->count) % stream->depth];
+}
+static void submit_slot(plzo_stream *stream, struct plzo_slot_s *slot){
+    slot->block.data = slot->in;
+    slot->block.data_size = slot->in_len;
+    if (stream->op == PLZO_COMPRESS){ // leave room for the frame header in front of the compressed data
+        slot->block.out = slot->out + PLZO_FRAME_HEADER_SIZE;
+        slot->block.out_size = PLZO_COMPRESS_BOUND(slot->in_len);
+    } else {
+        slot->block.out = slot->out;
+        slot->block.out_size = slot->raw_len;
+    }
+    pthread_mutex_lock(&stream->lock);
+    slot->state = SLOT_BUSY;
+    stream->count++;
+    pthread_mutex_unlock(&stream->lock);
+    slot->job = plzo_submit(stream->pool, stream->op | PLZO_RESERVED, &slot->block, 1, slot_done, slot);
+}
+plzo_stream *plzo_stream_open(plzo_pool *pool, int op, lzo_uint block_size, int depth){
+    int c;
+    if (block_size == 0){
+        block_size = PLZO_STREAM_BLOCK_SIZE;
+    }
+    if (depth <= 0){
+        depth = 2 * plzo_pool_threads(pool);
+    }
+    //the largest buffers a slot grows to in either direction, under a budget a stream takes at most half
+    //of it so another job always finds room, and waits until the slots fit
+    unsigned long long slot_bytes = op == PLZO_COMPRESS
+        ? plzo_buffer_bytes(block_size) + plzo_buffer_bytes(PLZO_FRAME_HEADER_SIZE + PLZO_COMPRESS_BOUND(block_size))
+        : plzo_buffer_bytes(PLZO_COMPRESS_BOUND(block_size)) + plzo_buffer_bytes(block_size);
+    while (depth > 1 && plzo_memory_limit() != 0 && depth * slot_bytes > plzo_memory_limit() / 2){
+        depth--;
+    }
+    if (plzo_memory_acquire(depth * slot_bytes) != LZO_E_OK){ // not even one slot fits
+        return NULL;
+    }
+    plzo_stream *stream = (plzo_stream *) xmalloc(sizeof(plzo_stream));
+    stream->pool = pool;
+    stream->op = op;
+    stream->block_size = block_size;
+    stream->depth = depth;
+    stream->held = depth * slot_bytes;
+    stream->head = 0;
+    stream->count = 0;
+    stream->header_len = 0;
+    stream->error = LZO_E_OK;
+    stream->notify = NULL;
+    stream->notify_user = NULL;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    stream->slots = (struct plzo_slot_s *) xmalloc(sizeof(struct plzo_slot_s) * depth);
+    for (c = 0; c < depth; c++){
+        struct plzo_slot_s *slot = &stream->slots[c];
+        slot->stream = stream;
+        slot->job = NULL;
+        slot->in_len = 0;
+        slot->raw_len = 0;
+        slot->comp_len = 0;
+        slot->state = SLOT_FREE;
+        if (op == PLZO_COMPRESS){
+            slot->in_cap = block_size;
+            slot->out_cap = PLZO_FRAME_HEADER_SIZE + PLZO_COMPRESS_BOUND(block_size);
+            slot->in = (lzo_bytep) plzo_buffer_get(slot->in_cap);
+            slot->out = (lzo_bytep) plzo_buffer_get(slot->out_cap);
+        } else { // sized by the frame headers as they arrive
+            slot->in_cap = 0;
+            slot->out_cap = 0;
+            slot->in = NULL;
+            slot->out = NULL;
+        }
+    }
+    return stream;
+}
+lzo_uint plzo_stream_write(plzo_stream *stream, const lzo_bytep data, lzo_uint len){
+    lzo_uint consumed = 0;
+    while (consumed < len && stream->count < stream->depth && stream->error == LZO_E_OK){ // a full ring pushes back on the caller
+        struct plzo_slot_s *slot = filling_slot(stream);
+        lzo_uint n;
+        if (stream->op == PLZO_COMPRESS){
+            n = stream->block_size - slot->in_len;
+            if (n > len - consumed){
+                n = len - consumed;
+            }
+            memcpy(slot->in + slot->in_len, data + consumed, n);
+            slot->in_len += n;
+            consumed += n;
+            if (slot->in_len == stream->block_size){
+                submit_slot(stream, slot);
+            }
+            continue;
+        }
+        if (stream->header_len < PLZO_FRAME_HEADER_SIZE){ // collect the frame header first
+            n = PLZO_FRAME_HEADER_SIZE - stream->header_len;
+            if (n > len - consumed){
+                n = len - consumed;
+            }
+            memcpy(stream->header + stream->header_len, data + consumed, n);
+            stream->header_len += n;
+            consumed += n;
+            if (stream->header_len < PLZO_FRAME_HEADER_SIZE){
+                break;
+            }
+            slot->raw_len = plzo_get_le32(stream->header);
+            slot->comp_len = plzo_get_le32(stream->header + 4);
+            if (slot->raw_len == 0 || slot->raw_len > stream->block_size
+                || slot->comp_len == 0 || slot->comp_len > PLZO_COMPRESS_BOUND(slot->raw_len)){
+                stream->error = LZO_E_ERROR;
+                break;
+            }
+            reserve(&slot->in, &slot->in_cap, slot->comp_len);
+            reserve(&slot->out, &slot->out_cap, slot->raw_len);
+            slot->in_len = 0;
+        }
+        n = slot->comp_len - slot->in_len;
+        if (n > len - consumed){
+            n = len - consumed;
+        }
+        memcpy(slot->in + slot->in_len, data + consumed, n);
+        slot->in_len += n;
+        consumed += n;
+        if (slot->in_len == slot->comp_len){
+            stream->header_len = 0;
+            submit_slot(stream, slot);
+        }
+    }
+    return consumed;
+}
+int plzo_stream_finish(plzo_stream *stream){
+    if (stream->error != LZO_E_OK){
+        return stream->error;
+    }
+    if (stream->count == stream->depth){ // no partially filled slot exists while the ring is full
+        return LZO_E_OK;
+    }
+    struct plzo_slot_s *slot = filling_slot(stream);
+    if (stream->op == PLZO_COMPRESS){
+        if (slot->in_len > 0){
+            submit_slot(stream, slot);
+        }
+        return LZO_E_OK;
+    }
+    if (stream->header_len > 0){ // the input ended inside a frame
+        return LZO_E_INPUT_OVERRUN;
+    }
+    return LZO_E_OK;
+}
+int plzo_stream_read(plzo_stream *stream, lzo_bytep *frame, lzo_uint *frame_size, int wait){
+    if (stream->count == 0){
+        return stream->error;
+    }
+    struct plzo_slot_s *slot = &stream->slots[stream->head];
+    pthread_mutex_lock(&stream->lock);
+    while (wait && slot->state != SLOT_DONE){
+        pthread_cond_wait(&stream->cond, &stream->lock);
+    }
+    if (slot->state != SLOT_DONE){
+        pthread_mutex_unlock(&stream->lock);
+        return 0;
+    }
+    slot->state = SLOT_FREE;
+    stream->head = (stream->head + 1) % stream->depth;
+    stream->count--;
+    pthread_mutex_unlock(&stream->lock);
+    int r = plzo_job_status(slot->job);
+    plzo_release(slot->job);
+    slot->job = NULL;
+    slot->in_len = 0;
+    if (r != LZO_E_OK){
+        return r;
+    }
+    if (stream->op == PLZO_COMPRESS){
+        plzo_put_le32(slot->out, slot->block.data_size);
+        plzo_put_le32(slot->out + 4, slot->block.out_size);
+        *frame = slot->out;
+        *frame_size = PLZO_FRAME_HEADER_SIZE + slot->block.out_size;
+    } else {
+        if (slot->block.out_size != slot->raw_len){
+            return LZO_E_ERROR;
+        }
+        *frame = slot->out;
+        *frame_size = slot->block.out_size;
+    }
+    return 1;
+}
+int plzo_stream_notify(plzo_stream *stream, void (*notify)(void *user), void *user){
+    int armed = 0;
+    pthread_mutex_lock(&stream->lock);
+    if (stream->count > 0 && stream->slots[stream->head].state != SLOT_DONE){
+        stream->notify = notify;
+        stream->notify_user = user;
+        armed = 1;
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return armed;
+}
+void plzo_stream_close(plzo_stream *stream){
+    int c;
+    pthread_mutex_lock(&stream->lock);
+    stream->notify = NULL;
+    for (c = 0; c < stream->depth; c++){
+        while (stream->slots[c].state == SLOT_BUSY){
+            pthread_cond_wait(&stream->cond, &stream->lock);
+        }
+    }
+    pthread_mutex_unlock(&stream->lock);
+    for (c = 0; c < stream->depth; c++){
+        if (stream->slots[c].job != NULL){
+            plzo_release(stream->slots[c].job);
+        }
+        plzo_buffer_put(stream->slots[c].in);
+        plzo_buffer_put(stream->slots[c].out);
+    }
+    free(stream->slots);
+    plzo_memory_release(stream->held);
+    pthread_cond_destroy(&stream->cond);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+}
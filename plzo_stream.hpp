@@ -0,0 +1,278 @@
+/* plzo_stream.hpp -- C++20 coroutine interface to the streaming engine
+
+   plzo::stream wraps plzo_stream. frame_ready() can be co_await'ed from
+   any coroutine: it suspends until the oldest block in flight finished
+   and resumes through the given scheduler (inline on the worker thread by
+   default). plzo::compress() and plzo::decompress() chain generators: the
+   producer coroutine yields input chunks, the engine yields frames as
+   blocks finish, and while depth blocks are in flight the producer is
+   simply not resumed. The frames come from an async_generator, consumed
+   with co_await frames.next(): a consumer waiting for a block is
+   suspended, no thread is parked, and it is resumed by the completion of
+   the block.
+
+   Build with -std=c++20 and link plzo_pool.c and plzo_stream.c.
+ */
+
+#ifndef PLZO_STREAM_HPP
+#define PLZO_STREAM_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "plzo.h"
+
+namespace plzo {
+
+using bytes = std::span<const unsigned char>;
+
+class error : public std::runtime_error {
+public:
+    explicit error(int code)
+        : std::runtime_error("plzo stream error " + std::to_string(code)), code_(code) {}
+    int code() const noexcept { return code_; }
+
+private:
+    int code_;
+};
+
+//minimal lazy generator, std::generator only arrives with C++23
+template <class T>
+class generator {
+public:
+    struct promise_type {
+        T value{};
+        std::exception_ptr exception;
+
+        generator get_return_object() { return generator(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T v) noexcept {
+            value = std::move(v);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        explicit iterator(handle h) : h_(h) {}
+        const T &operator*() const { return h_.promise().value; }
+        iterator &operator++() {
+            advance(h_);
+            return *this;
+        }
+        bool operator==(std::default_sentinel_t) const { return !h_ || h_.done(); }
+
+    private:
+        handle h_;
+    };
+
+    explicit generator(handle h) : h_(h) {}
+    generator(generator &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+    generator(const generator &) = delete;
+    generator &operator=(const generator &) = delete;
+    ~generator() {
+        if (h_)
+            h_.destroy();
+    }
+
+    iterator begin() {
+        advance(h_);
+        return iterator(h_);
+    }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+    static void advance(handle h) {
+        h.resume();
+        if (h.done() && h.promise().exception)
+            std::rethrow_exception(h.promise().exception);
+    }
+
+    handle h_;
+};
+
+//generator whose body may co_await, the consumer co_awaits next() and is resumed by whoever resumes
+//the body, possibly another thread
+template <class T>
+class async_generator {
+public:
+    struct promise_type {
+        T value{};
+        std::exception_ptr exception;
+        std::coroutine_handle<> consumer;
+
+        //hands control back to the consumer, by symmetric transfer so stacks do not grow
+        struct to_consumer {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                return h.promise().consumer;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        async_generator get_return_object() { return async_generator(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        to_consumer final_suspend() noexcept { return {}; }
+        to_consumer yield_value(T v) noexcept {
+            value = std::move(v);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class next_awaiter {
+    public:
+        explicit next_awaiter(handle h) : h_(h) {}
+        bool await_ready() const noexcept { return !h_ || h_.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept {
+            h_.promise().consumer = consumer;
+            return h_;
+        }
+        //false once the body returned, value() is valid until the next co_await next()
+        bool await_resume() const {
+            if (!h_)
+                return false;
+            if (h_.done() && h_.promise().exception)
+                std::rethrow_exception(h_.promise().exception);
+            return !h_.done();
+        }
+
+    private:
+        handle h_;
+    };
+
+    explicit async_generator(handle h) : h_(h) {}
+    async_generator(async_generator &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+    async_generator(const async_generator &) = delete;
+    async_generator &operator=(const async_generator &) = delete;
+    ~async_generator() {
+        if (h_)
+            h_.destroy();
+    }
+
+    next_awaiter next() { return next_awaiter(h_); }
+    const T &value() const { return h_.promise().value; }
+
+private:
+    handle h_;
+};
+
+class stream {
+public:
+    using scheduler = std::function<void(std::coroutine_handle<>)>;
+
+    stream(plzo_pool *pool, int op, lzo_uint block_size = 0, int depth = 0)
+        : s_(plzo_stream_open(pool, op, block_size, depth)) {
+        if (s_ == nullptr)
+            throw error(LZO_E_OUT_OF_MEMORY);
+    }
+    stream(const stream &) = delete;
+    stream &operator=(const stream &) = delete;
+    ~stream() { plzo_stream_close(s_); }
+
+    //returns how much of data was taken, less than all of it when the engine is full
+    std::size_t write(bytes data) {
+        return plzo_stream_write(s_, const_cast<lzo_bytep>(data.data()), data.size());
+    }
+    void finish() {
+        int r = plzo_stream_finish(s_);
+        if (r != LZO_E_OK)
+            throw error(r);
+    }
+    //next frame in input order, valid until the next write or finish
+    bool read(bytes &frame, bool wait = false) {
+        lzo_bytep data;
+        lzo_uint size;
+        int r = plzo_stream_read(s_, &data, &size, wait ? 1 : 0);
+        if (r < 0)
+            throw error(r);
+        if (r == 0)
+            return false;
+        frame = bytes(data, size);
+        return true;
+    }
+
+    class ready_awaiter {
+    public:
+        ready_awaiter(plzo_stream *s, scheduler sched) : s_(s), sched_(std::move(sched)) {}
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) {
+            h_ = h;
+            return plzo_stream_notify(s_, &ready_awaiter::wake, this) != 0;
+        }
+        void await_resume() const noexcept {}
+
+    private:
+        //the awaiter lives in the coroutine frame, so nothing of it is touched after resuming
+        static void wake(void *user) {
+            auto *self = static_cast<ready_awaiter *>(user);
+            std::coroutine_handle<> h = self->h_;
+            if (self->sched_) {
+                scheduler sched = std::move(self->sched_);
+                sched(h);
+            } else {
+                h.resume();
+            }
+        }
+
+        plzo_stream *s_;
+        scheduler sched_;
+        std::coroutine_handle<> h_;
+    };
+
+    //co_await'able, completes once read() returns the oldest frame without blocking, or false
+    //because nothing is in flight
+    ready_awaiter frame_ready(scheduler sched = {}) { return ready_awaiter(s_, std::move(sched)); }
+
+private:
+    plzo_stream *s_;
+};
+
+//feeds every chunk of input through a stream and yields the output frames in order, while the engine
+//is full or the last blocks are in flight the coroutine is suspended on frame_ready() and resumed
+//through sched once the oldest block finished
+inline async_generator<bytes> pipe(plzo_pool *pool, int op, generator<bytes> input, lzo_uint block_size = 0,
+                                   int depth = 0, stream::scheduler sched = {}) {
+    stream s(pool, op, block_size, depth);
+    bytes frame;
+    for (bytes chunk : input) {
+        while (!chunk.empty()) {
+            chunk = chunk.subspan(s.write(chunk));
+            if (!chunk.empty()) // engine full, wait for the oldest block
+                co_await s.frame_ready(sched);
+            while (s.read(frame))
+                co_yield frame;
+        }
+    }
+    s.finish();
+    for (;;) {
+        co_await s.frame_ready(sched);
+        if (!s.read(frame)) // nothing left in flight
+            break;
+        co_yield frame;
+    }
+}
+inline async_generator<bytes> compress(plzo_pool *pool, generator<bytes> input, lzo_uint block_size = 0,
+                                       int depth = 0, stream::scheduler sched = {}) {
+    return pipe(pool, PLZO_COMPRESS, std::move(input), block_size, depth, std::move(sched));
+}
+inline async_generator<bytes> decompress(plzo_pool *pool, generator<bytes> input, lzo_uint block_size = 0,
+                                         int depth = 0, stream::scheduler sched = {}) {
+    return pipe(pool, PLZO_DECOMPRESS, std::move(input), block_size, depth, std::move(sched));
+}
+
+} // namespace plzo
+
+#endif
@@ -0,0 +1,143 @@
+#include <lzo/lzoconf.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//required configuration
+static const char *progname = "plzo";
+#define WANT_LZO_MALLOC 1
+#define WANT_XMALLOC 1
+#include "portab.h"
+#include "plzo.h"
+
+struct trace_event_s {
+    const char *name;
+    unsigned long long start; // CLOCK_MONOTONIC nanoseconds
+    unsigned long long end;
+    unsigned long job;
+    long block;
+    unsigned long long bytes;
+};
+//events of one thread, only that thread appends, the list is walked when the trace is written
+struct trace_thread_s {
+    int tid;
+    char name[32];
+    struct trace_event_s *events;
+    int count;
+    int size;
+    struct trace_thread_s *next;
+};
+
+volatile int plzo_trace_on = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_thread_s *threads = NULL;
+static FILE *trace_file = NULL;
+static const char *trace_path = NULL;
+static unsigned long long trace_started;
+static __thread struct trace_thread_s *local = NULL;
+
+unsigned long long plzo_trace_clock(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+static struct trace_thread_s *this_thread(void){
+    if (local == NULL){
+        local = (struct trace_thread_s *) xmalloc(sizeof(struct trace_thread_s));
+        memset(local, 0, sizeof(struct trace_thread_s));
+        local->tid = (int) syscall(SYS_gettid);
+        snprintf(local->name, sizeof local->name, "thread %d", local->tid);
+        pthread_mutex_lock(&trace_lock);
+        local->next = threads;
+        threads = local;
+        pthread_mutex_unlock(&trace_lock);
+    }
+    return local;
+}
+int plzo_trace_start(const char *path){
+    trace_file = fopen(path, "w");
+    if (trace_file == NULL){
+        printf("cannot create %s\n", path);
+        return LZO_E_ERROR;
+    }
+    trace_path = path;
+    trace_started = plzo_trace_clock();
+    plzo_trace_on = 1;
+    plzo_trace_thread("main", -1);
+    return LZO_E_OK;
+}
+void plzo_trace_thread(const char *name, int index){
+    if (!plzo_trace_on){
+        return;
+    }
+    struct trace_thread_s *t = this_thread();
+    if (index >= 0){
+        snprintf(t->name, sizeof t->name, "%s %d", name, index);
+    } else {
+        snprintf(t->name, sizeof t->name, "%s", name);
+    }
+}
+void plzo_trace_span(const char *name, unsigned long long start, unsigned long job, long block, unsigned long long bytes){
+    unsigned long long end = plzo_trace_clock();
+    struct trace_thread_s *t = this_thread();
+    if (t->count == t->size){
+        t->size = t->size ? t->size * 2 : 1024;
+        struct trace_event_s *events = (struct trace_event_s *) xmalloc(sizeof(struct trace_event_s) * t->size);
+        if (t->count > 0){
+            memcpy(events, t->events, sizeof(struct trace_event_s) * t->count);
+        }
+        free(t->events);
+        t->events = events;
+    }
+    struct trace_event_s *e = &t->events[t->count++];
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    e->job = job;
+    e->block = block;
+    e->bytes = bytes;
+}
+//Trace Event Format: complete events ("X") in microseconds, one track per thread named by metadata events
+int plzo_trace_stop(void){
+    struct trace_thread_s *t, *next;
+    int pid = (int) getpid();
+    int first = 1;
+    int c;
+    if (trace_file == NULL){
+        return LZO_E_OK;
+    }
+    plzo_trace_on = 0;
+    pthread_mutex_lock(&trace_lock);
+    fprintf(trace_file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (t = threads; t != NULL; t = t->next){
+        fprintf(trace_file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",", pid, t->tid, t->name);
+        first = 0;
+        for (c = 0; c < t->count; c++){
+            const struct trace_event_s *e = &t->events[c];
+            fprintf(trace_file, ",\n{\"name\": \"%s\", \"cat\": \"block\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"job\": %lu, \"block\": %ld, \"bytes\": %llu}}",
+                    e->name, pid, t->tid, (e->start - trace_started) / 1000.0, (e->end - e->start) / 1000.0,
+                    e->job, e->block, e->bytes);
+        }
+    }
+    fprintf(trace_file, "\n]}\n");
+    for (t = threads; t != NULL; t = next){
+        next = t->next;
+        free(t->events);
+        free(t);
+    }
+    threads = NULL;
+    local = NULL;
+    pthread_mutex_unlock(&trace_lock);
+    int status = fclose(trace_file) == 0 ? LZO_E_OK : LZO_E_ERROR;
+    if (status != LZO_E_OK){
+        printf("write error - %s\n", trace_path);
+    }
+    trace_file = NULL;
+    return status;
+}
@@ -0,0 +1,227 @@
+/* interrupts appends to an archive and a .plzo file at every stage, by cutting the finished append
+   short, and checks that the members stored before are still listed and extract intact, then
+   appends again to an interrupted file; many small appends must grow the file by about their own
+   size, not by the index of everything stored before */
+#include <lzo/lzoconf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "../plzo.h"
+
+static plzo_pool *pool;
+static int failures = 0;
+
+static void fail(const char *what, unsigned long long cut){
+    fprintf(stderr, "append interrupt: %s at %llu bytes\n", what, cut);
+    failures++;
+}
+static unsigned char *pattern(size_t size, unsigned int seed){
+    unsigned char *data = (unsigned char *) malloc(size + 1);
+    size_t c;
+    for (c = 0; c < size; c++){
+        data[c] = (unsigned char) (((c * seed) % 251) ^ (c >> 10));
+    }
+    return data;
+}
+static void write_file(const char *name, const unsigned char *data, size_t size){
+    FILE *file = fopen(name, "wb");
+    if (file == NULL || fwrite(data, 1, size, file) != size){
+        fprintf(stderr, "cannot write %s\n", name);
+        exit(1);
+    }
+    fclose(file);
+}
+static unsigned char *read_file(const char *name, size_t *size){
+    FILE *file = fopen(name, "rb");
+    if (file == NULL){
+        fprintf(stderr, "cannot read %s\n", name);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    unsigned char *data = (unsigned char *) malloc(*size + 1);
+    fseek(file, 0, SEEK_SET);
+    if (fread(data, 1, *size, file) != *size){
+        exit(1);
+    }
+    fclose(file);
+    return data;
+}
+//size of a file, 0 if it does not exist
+static size_t file_size(const char *name){
+    FILE *file = fopen(name, "rb");
+    size_t size = 0;
+    if (file != NULL){
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    return size;
+}
+//true if member index of archive holds exactly size bytes of data
+static bool member_is(plzo_archive *archive, int index, const unsigned char *data, size_t size){
+    struct plzo_block_s *blocks;
+    const struct plzo_entry_s *e = plzo_archive_entry(archive, index);
+    if (e->size != size){
+        return false;
+    }
+    lzo_bytep comp = plzo_archive_load(archive, index, &blocks);
+    if (comp == NULL){
+        return false;
+    }
+    lzo_bytep out = (lzo_bytep) malloc(size + 1);
+    bool ok = plzo_batch(pool, PLZO_DECOMPRESS | PLZO_CHECKSUM, blocks, e->block_count, out, size) == LZO_E_OK
+        && memcmp(out, data, size) == 0;
+    free(out);
+    free(blocks);
+    plzo_buffer_put(comp);
+    return ok;
+}
+//writes prefixes of full from old_size on to cut_name, every byte of the footer and in steps before it,
+//and checks that each opens with the old_count members in data
+static void check_cuts(const char *cut_name, const unsigned char *full, size_t old_size, size_t new_size,
+                       int old_count, unsigned char **data, size_t *sizes){
+    size_t cut;
+    int c;
+    for (cut = old_size; cut < new_size; cut += cut + 2 * PLZO_ARCHIVE_FOOTER_SIZE < new_size ? 1021 : 1){
+        write_file(cut_name, full, cut);
+        plzo_archive *archive = plzo_archive_open(cut_name);
+        if (archive == NULL){
+            fail("not an archive", cut);
+            continue;
+        }
+        if (plzo_archive_count(archive) != old_count){
+            fail("member count changed", cut);
+        }
+        for (c = 0; c < old_count && c < plzo_archive_count(archive); c++){
+            if (!member_is(archive, c, data[c], sizes[c])){
+                fail("stored member lost", cut);
+            }
+        }
+        plzo_archive_close(archive);
+    }
+}
+int main(void){
+    char dir[] = "/tmp/plzo_append_XXXXXX";
+    size_t sizes[3] = {300000, 10, 1000000};
+    unsigned char *data[3];
+    char *names[3] = {"a", "b", "c"};
+    size_t old_size, new_size, full_size;
+    int c;
+    if (lzo_init() != LZO_E_OK || mkdtemp(dir) == NULL || chdir(dir) != 0){
+        fprintf(stderr, "append interrupt: cannot set up\n");
+        return 1;
+    }
+    //opening a cut file reports the interrupted append on stdout, once per cut
+    if (freopen("/dev/null", "w", stdout) == NULL){
+        return 1;
+    }
+    pool = plzo_pool_create(2);
+    for (c = 0; c < 3; c++){
+        data[c] = pattern(sizes[c], 7 + 2 * c);
+        write_file(names[c], data[c], sizes[c]);
+    }
+
+    //new members of an archive
+    if (plzo_archive_create(pool, "t.plza", names, 2, 65536) != LZO_E_OK){
+        fail("create", 0);
+    }
+    free(read_file("t.plza", &old_size));
+    if (plzo_archive_append(pool, "t.plza", names + 2, 1, 65536, 1) != LZO_E_OK){
+        fail("append", 0);
+    }
+    unsigned char *full = read_file("t.plza", &new_size);
+    check_cuts("cut.plza", full, old_size, new_size, 2, data, sizes);
+    //appending again to an interrupted archive writes over its tail
+    write_file("cut.plza", full, (old_size + new_size) / 2);
+    if (plzo_archive_append(pool, "cut.plza", names + 2, 1, 65536, 1) != LZO_E_OK){
+        fail("append after an interrupted append", 0);
+    }
+    plzo_archive *archive = plzo_archive_open("cut.plza");
+    if (archive == NULL || plzo_archive_count(archive) != 3){
+        fail("reappended archive", 0);
+    }
+    for (c = 0; archive != NULL && c < plzo_archive_count(archive); c++){
+        if (!member_is(archive, c, data[c], sizes[c])){
+            fail("reappended member", c);
+        }
+    }
+    if (archive != NULL){
+        plzo_archive_close(archive);
+    }
+    free(full);
+
+    //the last member of a .plzo growing, as with tail -f | lzo-pthread --append
+    if (plzo_archive_append(pool, "f.plzo", names, 1, 65536, 0) != LZO_E_OK){
+        fail("create .plzo", 0);
+    }
+    free(read_file("f.plzo", &old_size));
+    if (plzo_archive_append(pool, "f.plzo", names + 2, 1, 65536, 0) != LZO_E_OK){
+        fail("append to .plzo", 0);
+    }
+    full = read_file("f.plzo", &full_size);
+    check_cuts("cut.plzo", full, old_size, full_size, 1, data, sizes);
+    free(full);
+    //the whole append, whose member now runs on past the old trailer
+    unsigned char *grown = (unsigned char *) malloc(sizes[0] + sizes[2]);
+    memcpy(grown, data[0], sizes[0]);
+    memcpy(grown + sizes[0], data[2], sizes[2]);
+    archive = plzo_archive_open("f.plzo");
+    if (archive == NULL || !member_is(archive, 0, grown, sizes[0] + sizes[2])){
+        fail("grown member", full_size);
+    }
+    if (archive != NULL){
+        plzo_archive_close(archive);
+    }
+    free(grown);
+
+    //log shipping: many appends of a few bytes each, some of them write a complete trailer again
+    int appends = 300;
+    size_t line = 100;
+    unsigned char *log = pattern(appends * line, 13);
+    for (c = 0; c < appends; c++){
+        write_file("line", log + c * line, line);
+        char *one[] = {"line"};
+        old_size = file_size("g.plzo"); // the size before the last append is kept for the cuts
+        if (plzo_archive_append(pool, "g.plzo", one, 1, 65536, 0) != LZO_E_OK){
+            fail("small append", c);
+            break;
+        }
+    }
+    full = read_file("g.plzo", &full_size);
+    if (full_size > appends * (line + 256)){ // data, one table entry, one record and one footer each
+        fail("appends rewrite the index", full_size);
+    }
+    archive = plzo_archive_open("g.plzo");
+    if (archive == NULL || !member_is(archive, 0, log, appends * line)){
+        fail("member of many appends", full_size);
+    }
+    if (archive != NULL){
+        plzo_archive_close(archive);
+    }
+    size_t log_size = (appends - 1) * line; // the member before the last append
+    check_cuts("cut.plzo", full, old_size, full_size, 1, &log, &log_size);
+    free(full);
+    free(log);
+
+    const char *files[] = {"a", "b", "c", "t.plza", "cut.plza", "f.plzo", "cut.plzo", "g.plzo", "line"};
+    for (c = 0; c < (int) (sizeof files / sizeof files[0]); c++){
+        unlink(files[c]);
+    }
+    if (chdir("/") == 0){
+        rmdir(dir);
+    }
+    for (c = 0; c < 3; c++){
+        free(data[c]);
+    }
+    plzo_pool_destroy(pool);
+    if (failures > 0){
+        fprintf(stderr, "append interrupt: FAILED, %d checks\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "append interrupt: ok\n");
+    return 0;
+}
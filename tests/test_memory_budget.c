@@ -0,0 +1,121 @@
+/* submits jobs straight to the pool and the serial executor under a memory budget: jobs are charged
+   their block sizes while they run and never together above the limit, a job larger than the limit
+   fails with LZO_E_OUT_OF_MEMORY, and PLZO_RESERVED jobs are not charged again */
+#include <lzo/lzoconf.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../plzo.h"
+
+#define LIMIT (1024 * 1024)
+#define BLOCK (64 * 1024)
+
+static plzo_pool *pool;
+static int failures = 0;
+static int finished = 0; // submitter threads done
+
+static void fail(const char *what){
+    fprintf(stderr, "memory budget: %s\n", what);
+    __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED); // also from the submitter threads
+}
+//compresses size bytes in blocks of BLOCK with plzo_batch, returns its status
+static int batch(int op, unsigned long size){
+    int count = (int) ((size + BLOCK - 1) / BLOCK);
+    struct plzo_block_s *blocks = (struct plzo_block_s *) malloc(sizeof(struct plzo_block_s) * count);
+    lzo_bytep data = (lzo_bytep) malloc(size);
+    int c;
+    for (c = 0; c < (int) size; c++){
+        data[c] = (unsigned char) (c % 251 ^ c >> 12);
+    }
+    for (c = 0; c < count; c++){
+        blocks[c].data = data + (unsigned long) c * BLOCK;
+        blocks[c].data_size = c == count - 1 ? size - (unsigned long) c * BLOCK : BLOCK;
+    }
+    lzo_uint arena_size = plzo_batch_bound(PLZO_COMPRESS, blocks, count);
+    lzo_bytep arena = (lzo_bytep) malloc(arena_size);
+    int r = plzo_batch(pool, op, blocks, count, arena, arena_size);
+    for (c = 0; c < count && r == LZO_E_OUT_OF_MEMORY; c++){
+        if (blocks[c].status != LZO_E_OUT_OF_MEMORY){
+            fail("a rejected block is not marked");
+        }
+    }
+    free(arena);
+    free(data);
+    free(blocks);
+    return r;
+}
+static void *submitter(void *arg){
+    int c;
+    (void) arg;
+    for (c = 0; c < 20; c++){
+        if (batch(PLZO_COMPRESS | PLZO_CHECKSUM, 300000) != LZO_E_OK){
+            fail("a job within the budget failed");
+        }
+    }
+    __atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+int main(void){
+    pthread_t threads[4];
+    unsigned long long peak = 0;
+    int c;
+    if (lzo_init() != LZO_E_OK){
+        return 1;
+    }
+    pool = plzo_pool_create(2);
+    plzo_set_memory_limit(LIMIT);
+
+    if (batch(PLZO_COMPRESS, 200000) != LZO_E_OK || plzo_memory_used() != 0){
+        fail("a small job is not given back");
+    }
+    if (batch(PLZO_COMPRESS, 2 * LIMIT) != LZO_E_OUT_OF_MEMORY || plzo_memory_used() != 0){
+        fail("a job larger than the limit is not rejected");
+    }
+    if (batch(PLZO_COMPRESS | PLZO_RESERVED, 2 * LIMIT) != LZO_E_OK || plzo_memory_used() != 0){
+        fail("a reserved job is charged");
+    }
+
+    //four threads of jobs that fit one or two at a time
+    for (c = 0; c < 4; c++){
+        pthread_create(&threads[c], NULL, submitter, NULL);
+    }
+    while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < 4){
+        unsigned long long used = plzo_memory_used();
+        peak = used > peak ? used : peak;
+    }
+    for (c = 0; c < 4; c++){
+        pthread_join(threads[c], NULL);
+    }
+    if (peak > LIMIT){
+        fail("jobs ran together above the limit");
+    }
+    if (peak == 0 || plzo_memory_used() != 0){
+        fail("jobs are not charged while they run");
+    }
+
+    plzo_exec *exec = plzo_exec_create(PLZO_EXEC_SERIAL, 1, NULL);
+    struct plzo_block_s block;
+    block.data = (lzo_bytep) malloc(LIMIT);
+    block.data_size = LIMIT;
+    block.out = (lzo_bytep) malloc(PLZO_COMPRESS_BOUND(LIMIT));
+    block.out_size = PLZO_COMPRESS_BOUND(LIMIT);
+    if (plzo_exec_run(exec, PLZO_COMPRESS, &block, 1) != LZO_E_OUT_OF_MEMORY || plzo_memory_used() != 0){
+        fail("the serial executor runs a job larger than the limit");
+    }
+    free(block.data);
+    free(block.out);
+    plzo_exec_destroy(exec);
+
+    if (plzo_stream_open(pool, PLZO_COMPRESS, LIMIT, 1) != NULL){
+        fail("a stream with slots larger than the limit opens");
+    }
+
+    plzo_pool_destroy(pool);
+    if (failures > 0){
+        fprintf(stderr, "memory budget: FAILED, %d checks\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "memory budget: ok\n");
+    return 0;
+}
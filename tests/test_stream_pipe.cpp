@@ -0,0 +1,82 @@
+// runs plzo::compress() and plzo::decompress() end to end: a coroutine consumes the frames with
+// co_await next() while the generators suspend on frame_ready(), then the output is compared with the input
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <latch>
+#include <thread>
+#include <vector>
+
+#include "../plzo_stream.hpp"
+
+namespace {
+
+//starts right away and runs to the end on whatever thread resumes it
+struct detached {
+    struct promise_type {
+        detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+std::atomic<int> resumed_elsewhere{0};
+
+plzo::generator<plzo::bytes> chunks(const std::vector<unsigned char> &data, std::size_t chunk) {
+    for (std::size_t off = 0; off < data.size(); off += chunk)
+        co_yield plzo::bytes(data.data() + off, std::min(chunk, data.size() - off));
+}
+
+detached collect(plzo::async_generator<plzo::bytes> frames, std::vector<unsigned char> &out, int &error,
+                 std::latch &done) {
+    std::thread::id caller = std::this_thread::get_id();
+    try {
+        while (co_await frames.next()) {
+            if (std::this_thread::get_id() != caller)
+                resumed_elsewhere++;
+            out.insert(out.end(), frames.value().begin(), frames.value().end());
+        }
+    } catch (const plzo::error &e) {
+        error = e.code();
+    }
+    done.count_down();
+}
+
+//runs one direction of the pipe and waits for the consumer to finish
+std::vector<unsigned char> run(plzo_pool *pool, int op, const std::vector<unsigned char> &in, int &error) {
+    std::vector<unsigned char> out;
+    std::latch done(1);
+    plzo::async_generator<plzo::bytes> frames = op == PLZO_COMPRESS
+        ? plzo::compress(pool, chunks(in, 100000), 64 * 1024, 2)
+        : plzo::decompress(pool, chunks(in, 77777), 64 * 1024, 2);
+    collect(std::move(frames), out, error, done);
+    done.wait();
+    return out;
+}
+
+} // namespace
+
+int main() {
+    if (lzo_init() != LZO_E_OK) {
+        std::printf("lzo init failed\n");
+        return 1;
+    }
+    plzo_pool *pool = plzo_pool_create(2);
+    std::vector<unsigned char> data(5 << 20);
+    for (std::size_t c = 0; c < data.size(); c++)
+        data[c] = (unsigned char) (((c * 7) % 251) ^ (c >> 12));
+    int error = LZO_E_OK;
+    std::vector<unsigned char> comp = run(pool, PLZO_COMPRESS, data, error);
+    std::vector<unsigned char> back = error == LZO_E_OK ? run(pool, PLZO_DECOMPRESS, comp, error) : comp;
+    plzo_pool_destroy(pool);
+    if (error != LZO_E_OK || back != data) {
+        std::printf("stream pipe: FAILED (error %d, %zu of %zu bytes back)\n", error, back.size(), data.size());
+        return 1;
+    }
+    std::printf("stream pipe: ok, %zu bytes in %zu compressed, %d frames resumed by a worker\n", data.size(),
+                comp.size(), resumed_elsewhere.load());
+    return 0;
+}